@@ -32,6 +32,10 @@ public:
     ~AlgorithmA();
     bool insertIfAbsent(const int tid, const int & key);
     bool erase(const int tid, const int & key);
+    bool contains(const int tid, const int & key);
+    int insertBatch(const int tid, const int * keys, int n, bool * results);
+    int eraseBatch(const int tid, const int * keys, int n, bool * results);
+    int containsBatch(const int tid, const int * keys, int n, bool * results);
     long getSumOfKeys();
     void printDebuggingDetails(); 
 };
@@ -43,7 +47,7 @@ public:
  * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
  */
 AlgorithmA::AlgorithmA(const int _numThreads, const int _capacity)
-: numThreads(_numThreads), capacity(_capacity), table(_capacity), mutexes(_capacity) {
+: numThreads(_numThreads), capacity(roundCapacity(_capacity)), table(capacity), mutexes(capacity) {
     for (int i = 0; i < capacity; i++){
         table[i] = EMPTY;
     }
@@ -59,7 +63,7 @@ bool AlgorithmA::insertIfAbsent(const int tid, const int & key) {
     uint32_t h = murmur3(key);
 
     for (int i = 0; i < capacity; i++){
-        int index = (h+i) % capacity;
+        int index = probeIndex(h, i, capacity);
         // printf("Lock %d acquired by thread %d\n", index, tid);
         mutexes[index].lock();
         int found = table[index];
@@ -87,7 +91,7 @@ bool AlgorithmA::erase(const int tid, const int & key) {
     uint32_t h = murmur3(key);
 
     for (int i = 0; i < capacity; i++){
-        int index = (h+i) % capacity;
+        int index = probeIndex(h, i, capacity);
         mutexes[index].lock();
         // printf("Lock %d acquired by thread %d\n", index, tid);
         int found = table[index];
@@ -108,22 +112,57 @@ bool AlgorithmA::erase(const int tid, const int & key) {
     return false;
 }
 
+// semantics: return true if key is in the set, and false otherwise
+// (reads without locking: a slot only ever changes with a single store, so a reader sees either the old or the new value)
+bool AlgorithmA::contains(const int tid, const int & key) {
+    uint32_t h = murmur3(key);
+
+    for (int i = 0; i < capacity; i++){
+        int index = probeIndex(h, i, capacity);
+        int found = table[index];
+        if (found == key){
+            return true;
+        }
+        else if (found == EMPTY){
+            return false;
+        }
+    }
+    return false;
+}
+
+// semantics: results[j] = insertIfAbsent(tid, keys[j]) for every j < n, in order; returns how many are true
+// (see runBatch: the home slots of upcoming keys are prefetched while earlier ones are inserted)
+int AlgorithmA::insertBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return insertIfAbsent(tid, keys[j]); });
+}
+
+// semantics: results[j] = erase(tid, keys[j]) for every j < n, in order; returns how many are true
+int AlgorithmA::eraseBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return erase(tid, keys[j]); });
+}
+
+// semantics: results[j] = contains(tid, keys[j]) for every j < n; returns how many are true
+int AlgorithmA::containsBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<false>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                       [&](int j) { return contains(tid, keys[j]); });
+}
 
 // semantics: return the sum of all KEYS in the set
 int64_t AlgorithmA::getSumOfKeys() {
-    int64_t sum = 0;
-
-    // Lock-based reading on the table to safely access shared data
-    for (int i = 0; i < capacity; i++) {
-        // std::lock_guard<std::mutex> lock(mutexes[i]);  // Lock the mutex before accessing the table
-        mutexes[i].lock();
-        if (table[i] != EMPTY && table[i] != TOMBSTONE) {
-            sum += table[i];  // Add the key to the sum if it's not empty or tombstone
+    // Lock-based reading on the table to safely access shared data (chunks in parallel, see parallelSum in util.h)
+    return parallelSum(capacity, [&](int64_t begin, int64_t end) {
+        int64_t sum = 0;
+        for (int64_t i = begin; i < end; i++) {
+            mutexes[i].lock();
+            if (table[i] != EMPTY && table[i] != TOMBSTONE) {
+                sum += table[i];  // Add the key to the sum if it's not empty or tombstone
+            }
+            mutexes[i].unlock();
         }
-        mutexes[i].unlock();
-    }    
-
-    return sum;
+        return sum;
+    });
 }
 
 
@@ -0,0 +1,351 @@
+#pragma once
+#include "util.h"
+#include <atomic>
+#include <thread>
+using namespace std;
+
+// Default number of lock stripes (fewer if the table has fewer slots); -DSTRIPED_A_STRIPES=... overrides it
+#ifndef STRIPED_A_STRIPES
+#define STRIPED_A_STRIPES 4096
+#endif
+
+/**
+ * Stripe locks for AlgorithmAStriped. Each one fills a cache line, so threads working on neighbouring
+ * stripes do not share one. They all have the same interface:
+ *
+ * lock / unlock:           exclusive, taken by insertIfAbsent and erase
+ * readLock / readUnlock:   taken by contains; readLock returns a token that is passed back to readUnlock,
+ *                          which returns false if what was read under it may be inconsistent (then the
+ *                          reader probes again)
+ */
+
+// called once per failed attempt in every spin loop below: after a while the thread yields its CPU, so a
+// lock holder (or the next thread in an MCS queue) that was preempted gets to run when threads outnumber cores
+inline void stripeLockBackoff(int & spins) {
+    if (++spins >= 64) {
+        std::this_thread::yield();
+        spins = 0;
+    }
+}
+
+// Reader-writer spinlock: any number of readers or one writer. A writer announces itself first (which stops
+// new readers from entering) and then waits for the readers inside to leave, so writers are not starved.
+struct alignas(PADDING_BYTES) rwStripeLock {
+    static constexpr const char * name = "reader-writer spinlock";
+    static constexpr uint32_t WRITER = 1u << 31;
+    std::atomic<uint32_t> state;                    // WRITER bit | number of readers
+
+    rwStripeLock() : state(0) {}
+    void lock() {
+        int spins = 0;
+        while (true) {
+            uint32_t s = state.load(std::memory_order_relaxed);
+            if (!(s & WRITER) && state.compare_exchange_weak(s, s | WRITER, std::memory_order_acquire))
+                break;
+            stripeLockBackoff(spins);
+        }
+        while (state.load(std::memory_order_acquire) != WRITER) stripeLockBackoff(spins);
+    }
+    void unlock() {
+        state.store(0, std::memory_order_release);
+    }
+    uint64_t readLock() {
+        int spins = 0;
+        while (true) {
+            uint32_t s = state.load(std::memory_order_relaxed);
+            if (!(s & WRITER) && state.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+                return 0;
+            stripeLockBackoff(spins);
+        }
+    }
+    bool readUnlock(uint64_t token) {
+        state.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+};
+
+// MCS queue lock: waiting threads form a queue and each one spins on its own node, so a release touches only
+// the next waiter's cache line. Readers are exclusive too. A thread holds at most one stripe at a time, so one
+// queue node per thread is enough.
+struct alignas(PADDING_BYTES) mcsStripeLock {
+    static constexpr const char * name = "MCS queue lock";
+    struct alignas(PADDING_BYTES) qnode {
+        std::atomic<qnode *> next;
+        std::atomic<bool> waiting;
+    };
+    std::atomic<qnode *> tail;
+
+    mcsStripeLock() : tail(NULL) {}
+    static qnode & myNode() {
+        static thread_local qnode node;
+        return node;
+    }
+    void lock() {
+        qnode & me = myNode();
+        me.next.store(NULL, std::memory_order_relaxed);
+        me.waiting.store(true, std::memory_order_relaxed);
+        qnode * pred = tail.exchange(&me, std::memory_order_acq_rel);
+        if (pred) {
+            pred->next.store(&me, std::memory_order_release);
+            int spins = 0;
+            while (me.waiting.load(std::memory_order_acquire)) stripeLockBackoff(spins);
+        }
+    }
+    void unlock() {
+        qnode & me = myNode();
+        qnode * succ = me.next.load(std::memory_order_acquire);
+        if (!succ) {
+            qnode * expected = &me;
+            if (tail.compare_exchange_strong(expected, NULL, std::memory_order_release, std::memory_order_relaxed))
+                return;
+            // a thread has swapped itself into tail but not linked itself to us yet
+            int spins = 0;
+            while (!(succ = me.next.load(std::memory_order_acquire))) stripeLockBackoff(spins);
+        }
+        succ->waiting.store(false, std::memory_order_release);
+    }
+    uint64_t readLock() {
+        lock();
+        return 0;
+    }
+    bool readUnlock(uint64_t token) {
+        unlock();
+        return true;
+    }
+};
+
+// Seqlock: writers make the version odd while they hold the stripe; readers write nothing, they read the version
+// before and after and retry if it changed (same scheme as the stripe versions of AlgorithmE)
+struct alignas(PADDING_BYTES) seqStripeLock {
+    static constexpr const char * name = "seqlock";
+    std::atomic<uint64_t> version;                  // even = unlocked, odd = a writer holds it
+
+    seqStripeLock() : version(0) {}
+    void lock() {
+        int spins = 0;
+        while (true) {
+            uint64_t v = version.load(std::memory_order_relaxed);
+            if (!(v & 1) && version.compare_exchange_weak(v, v + 1, std::memory_order_acquire))
+                break;
+            stripeLockBackoff(spins);
+        }
+        // readers that see any of our slot writes must also see the odd version
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    void unlock() {
+        version.fetch_add(1, std::memory_order_release);
+    }
+    uint64_t readLock() {
+        uint64_t v;
+        int spins = 0;
+        while ((v = version.load(std::memory_order_acquire)) & 1) stripeLockBackoff(spins);
+        return v;
+    }
+    bool readUnlock(uint64_t token) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version.load(std::memory_order_relaxed) == token;
+    }
+};
+
+/**
+ * Lock-based static hash table like AlgorithmA, but with one lock per stripe of consecutive slots instead
+ * of one std::mutex per slot. A probe keeps the lock of the stripe it is in and only switches locks when it
+ * crosses into the next stripe, so most operations take a single lock. A thread never holds two stripes
+ * at once, so there is no lock ordering to get wrong.
+ *
+ * StripeLock is one of rwStripeLock, mcsStripeLock and seqStripeLock (see above).
+ */
+template <class StripeLock>
+class AlgorithmAStriped {
+public:
+    static constexpr int TOMBSTONE = -1;
+    static constexpr int EMPTY = -2;
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    int capacity;
+    int numStripes;
+    int slotsPerStripe;
+    char padding2[PADDING_BYTES];
+
+    std::atomic<int> * table;
+    char padding3[PADDING_BYTES];
+    StripeLock * locks;
+    char padding4[PADDING_BYTES];
+
+    AlgorithmAStriped(const int _numThreads, const int _capacity, const int _numStripes = STRIPED_A_STRIPES);
+    ~AlgorithmAStriped();
+    bool insertIfAbsent(const int tid, const int & key);
+    bool erase(const int tid, const int & key);
+    bool contains(const int tid, const int & key);
+    int insertBatch(const int tid, const int * keys, int n, bool * results);
+    int eraseBatch(const int tid, const int * keys, int n, bool * results);
+    int containsBatch(const int tid, const int * keys, int n, bool * results);
+    long getSumOfKeys();
+    void printDebuggingDetails();
+
+private:
+    int stripeOf(int index) { return index / slotsPerStripe; }
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
+ * @param _numStripes number of locks; each covers capacity / _numStripes consecutive slots (rounded up)
+ */
+template <class StripeLock>
+AlgorithmAStriped<StripeLock>::AlgorithmAStriped(const int _numThreads, const int _capacity, const int _numStripes)
+: numThreads(_numThreads), capacity(roundCapacity(_capacity)) {
+    numStripes = std::max(1, std::min(_numStripes, capacity));
+    slotsPerStripe = (capacity + numStripes - 1) / numStripes;
+    numStripes = (capacity + slotsPerStripe - 1) / slotsPerStripe;
+    table = new std::atomic<int>[capacity];
+    locks = new StripeLock[numStripes];
+    for (int i = 0; i < capacity; i++) {
+        table[i].store(EMPTY, std::memory_order_relaxed);
+    }
+}
+
+// destructor: clean up any allocated memory, etc.
+template <class StripeLock>
+AlgorithmAStriped<StripeLock>::~AlgorithmAStriped() {
+    delete[] table;
+    delete[] locks;
+}
+
+// semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
+template <class StripeLock>
+bool AlgorithmAStriped<StripeLock>::insertIfAbsent(const int tid, const int & key) {
+    uint32_t h = murmur3(key);
+    int held = -1;
+
+    for (int i = 0; i < capacity; i++) {
+        int index = probeIndex(h, i, capacity);
+        if (stripeOf(index) != held) {
+            if (held >= 0) locks[held].unlock();
+            held = stripeOf(index);
+            locks[held].lock();
+        }
+        int found = table[index].load(std::memory_order_relaxed);
+        if (found == key) {
+            locks[held].unlock();
+            return false;
+        } else if (found == EMPTY) {
+            table[index].store(key, std::memory_order_relaxed);
+            locks[held].unlock();
+            return true;
+        }
+    }
+    if (held >= 0) locks[held].unlock();
+    return false;
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+template <class StripeLock>
+bool AlgorithmAStriped<StripeLock>::erase(const int tid, const int & key) {
+    uint32_t h = murmur3(key);
+    int held = -1;
+
+    for (int i = 0; i < capacity; i++) {
+        int index = probeIndex(h, i, capacity);
+        if (stripeOf(index) != held) {
+            if (held >= 0) locks[held].unlock();
+            held = stripeOf(index);
+            locks[held].lock();
+        }
+        int found = table[index].load(std::memory_order_relaxed);
+        if (found == EMPTY) {
+            locks[held].unlock();
+            return false;
+        } else if (found == key) {
+            table[index].store(TOMBSTONE, std::memory_order_relaxed);
+            locks[held].unlock();
+            return true;
+        }
+    }
+    if (held >= 0) locks[held].unlock();
+    return false;
+}
+
+// semantics: return true if key is in the set, and false otherwise
+// (holds each stripe's read lock while probing it; probes again from the start if readUnlock reports a conflict)
+template <class StripeLock>
+bool AlgorithmAStriped<StripeLock>::contains(const int tid, const int & key) {
+    uint32_t h = murmur3(key);
+
+    while (true) {
+        int held = -1;
+        uint64_t token = 0;
+        bool consistent = true;
+        bool result = false;
+        for (int i = 0; i < capacity; i++) {
+            int index = probeIndex(h, i, capacity);
+            if (stripeOf(index) != held) {
+                if (held >= 0 && !locks[held].readUnlock(token)) {
+                    consistent = false;
+                    held = -1;
+                    break;
+                }
+                held = stripeOf(index);
+                token = locks[held].readLock();
+            }
+            int found = table[index].load(std::memory_order_relaxed);
+            if (found == key) {
+                result = true;
+                break;
+            } else if (found == EMPTY) {
+                break;
+            }
+        }
+        if (held >= 0 && !locks[held].readUnlock(token))
+            consistent = false;
+        if (consistent)
+            return result;
+    }
+}
+
+// semantics: results[j] = insertIfAbsent(tid, keys[j]) for every j < n, in order; returns how many are true
+// (see runBatch: the home slots of upcoming keys are prefetched while earlier ones are inserted)
+template <class StripeLock>
+int AlgorithmAStriped<StripeLock>::insertBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return insertIfAbsent(tid, keys[j]); });
+}
+
+// semantics: results[j] = erase(tid, keys[j]) for every j < n, in order; returns how many are true
+template <class StripeLock>
+int AlgorithmAStriped<StripeLock>::eraseBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return erase(tid, keys[j]); });
+}
+
+// semantics: results[j] = contains(tid, keys[j]) for every j < n; returns how many are true
+template <class StripeLock>
+int AlgorithmAStriped<StripeLock>::containsBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<false>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                       [&](int j) { return contains(tid, keys[j]); });
+}
+
+// semantics: return the sum of all KEYS in the set
+template <class StripeLock>
+int64_t AlgorithmAStriped<StripeLock>::getSumOfKeys() {
+    // chunks in parallel, each stripe's slots summed under its lock (see parallelSum and sumLiveKeys in util.h)
+    return parallelSum(capacity, [&](int64_t begin, int64_t end) {
+        int64_t sum = 0;
+        for (int s = stripeOf(begin); s <= stripeOf(end - 1); s++) {
+            locks[s].lock();
+            sum += sumLiveKeys((const int *) table, std::max(begin, (int64_t) s * slotsPerStripe),
+                               std::min(end, (int64_t) (s + 1) * slotsPerStripe), EMPTY, TOMBSTONE);
+            locks[s].unlock();
+        }
+        return sum;
+    });
+}
+
+// print any debugging details you want at the end of a trial in this function
+template <class StripeLock>
+void AlgorithmAStriped<StripeLock>::printDebuggingDetails() {
+    cout<<"stripe lock: "<<StripeLock::name<<", "<<numStripes<<" stripes of "<<slotsPerStripe<<" slots ("<<sizeof(StripeLock)<<" bytes each)"<<endl;
+}
@@ -23,6 +23,10 @@ public:
     ~AlgorithmB();
     bool insertIfAbsent(const int tid, const int & key);
     bool erase(const int tid, const int & key);
+    bool contains(const int tid, const int & key);
+    int insertBatch(const int tid, const int * keys, int n, bool * results);
+    int eraseBatch(const int tid, const int * keys, int n, bool * results);
+    int containsBatch(const int tid, const int * keys, int n, bool * results);
     long getSumOfKeys();
     void printDebuggingDetails(); 
 };
@@ -34,7 +38,7 @@ public:
  * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
  */
 AlgorithmB::AlgorithmB(const int _numThreads, const int _capacity)
-: numThreads(_numThreads), capacity(_capacity), table(_capacity), mutexes(_capacity) {
+: numThreads(_numThreads), capacity(roundCapacity(_capacity)), table(capacity), mutexes(capacity) {
     for (int i = 0; i < capacity; i++){
         table[i] = EMPTY;
     }
@@ -51,7 +55,7 @@ bool AlgorithmB::insertIfAbsent(const int tid, const int & key) {
     // Such a big deal in performance! If we put the h type as uint64, the performance degrades ~ 15%
     volatile bool flag = false;
     for (int i = 0; i < capacity; i++){
-        int index = (h+i) % capacity;
+        int index = probeIndex(h, i, capacity);
         int found = table[index];
         flag = false;
         
@@ -78,7 +82,7 @@ bool AlgorithmB::erase(const int tid, const int & key) {
     volatile bool flag = false;
 
     for (int i = 0; i < capacity; i++){
-        int index = (h+i) % capacity;
+        int index = probeIndex(h, i, capacity);
         int found = table[index];
         flag = false;
 
@@ -99,17 +103,49 @@ bool AlgorithmB::erase(const int tid, const int & key) {
     return false;
 }
 
+// semantics: return true if key is in the set, and false otherwise
+bool AlgorithmB::contains(const int tid, const int & key) {
+    uint32_t h = murmur3(key);
+
+    for (int i = 0; i < capacity; i++){
+        int index = probeIndex(h, i, capacity);
+        int found = table[index];
+
+        if (found == key){
+            return true;
+        }
+        else if (found == EMPTY){
+            return false;
+        }
+    }
+    return false;
+}
+
+// semantics: results[j] = insertIfAbsent(tid, keys[j]) for every j < n, in order; returns how many are true
+// (see runBatch: the home slots of upcoming keys are prefetched while earlier ones are inserted)
+int AlgorithmB::insertBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return insertIfAbsent(tid, keys[j]); });
+}
+
+// semantics: results[j] = erase(tid, keys[j]) for every j < n, in order; returns how many are true
+int AlgorithmB::eraseBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return erase(tid, keys[j]); });
+}
+
+// semantics: results[j] = contains(tid, keys[j]) for every j < n; returns how many are true
+int AlgorithmB::containsBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<false>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                       [&](int j) { return contains(tid, keys[j]); });
+}
 
 // semantics: return the sum of all KEYS in the set
 int64_t AlgorithmB::getSumOfKeys() {
-    int64_t sum = 0;
-    for (int i = 0; i < capacity; i++) {
-        // std::lock_guard<std::mutex> lock(mutexes[i]);  // Lock the mutex before accessing the table
-        if (table[i] != EMPTY && table[i] != TOMBSTONE) {
-            sum += table[i];  
-        }
-    }    
-    return sum;
+    // (parallel, vectorized: see parallelSum and sumLiveKeys in util.h)
+    return parallelSum(capacity, [&](int64_t begin, int64_t end) {
+        return sumLiveKeys(table.data(), begin, end, EMPTY, TOMBSTONE);
+    });
 }
 
 
@@ -20,6 +20,10 @@ public:
     ~AlgorithmC();
     bool insertIfAbsent(const int tid, const int & key);
     bool erase(const int tid, const int & key);
+    bool contains(const int tid, const int & key);
+    int insertBatch(const int tid, const int * keys, int n, bool * results);
+    int eraseBatch(const int tid, const int * keys, int n, bool * results);
+    int containsBatch(const int tid, const int * keys, int n, bool * results);
     long getSumOfKeys();
     void printDebuggingDetails(); 
 };
@@ -31,7 +35,7 @@ public:
  * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
  */
 AlgorithmC::AlgorithmC(const int _numThreads, const int _capacity)
-: numThreads(_numThreads), capacity(_capacity), table(_capacity) {
+: numThreads(_numThreads), capacity(roundCapacity(_capacity)), table(capacity) {
     for (int i = 0; i < capacity; i++){
         table[i].store(EMPTY, std::memory_order_relaxed);
     }
@@ -48,7 +52,7 @@ bool AlgorithmC::insertIfAbsent(const int tid, const int & key) {
     uint32_t h = murmur3(key);
 
     for (int i = 0; i < capacity; i++){
-        int index = (h+i) % capacity;
+        int index = probeIndex(h, i, capacity);
         int found = table[index];
 
         if (found == key){
@@ -71,7 +75,7 @@ bool AlgorithmC::erase(const int tid, const int & key) {
     uint32_t h = murmur3(key);
 
     for (int i = 0; i < capacity; i++){
-        int index = (h+i) % capacity;
+        int index = probeIndex(h, i, capacity);
         int found = table[index];
 
         if(found == EMPTY){
@@ -129,17 +133,49 @@ bool AlgorithmC::erase(const int tid, const int & key) {
 //     return false;
 // }
 
+// semantics: return true if key is in the set, and false otherwise
+bool AlgorithmC::contains(const int tid, const int & key) {
+    uint32_t h = murmur3(key);
+
+    for (int i = 0; i < capacity; i++){
+        int index = probeIndex(h, i, capacity);
+        int found = table[index].load(std::memory_order_acquire);
+
+        if (found == key){
+            return true;
+        }
+        else if (found == EMPTY){
+            return false;
+        }
+    }
+    return false;
+}
+
+// semantics: results[j] = insertIfAbsent(tid, keys[j]) for every j < n, in order; returns how many are true
+// (see runBatch: the home slots of upcoming keys are prefetched while earlier ones are inserted)
+int AlgorithmC::insertBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return insertIfAbsent(tid, keys[j]); });
+}
+
+// semantics: results[j] = erase(tid, keys[j]) for every j < n, in order; returns how many are true
+int AlgorithmC::eraseBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return erase(tid, keys[j]); });
+}
+
+// semantics: results[j] = contains(tid, keys[j]) for every j < n; returns how many are true
+int AlgorithmC::containsBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<false>(n, results, [&](int j) { return &table[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                       [&](int j) { return contains(tid, keys[j]); });
+}
 
 // Get sum of all keys (not lock-free, but reads safely)
 int64_t AlgorithmC::getSumOfKeys() {
-    int64_t sum = 0;
-    for (int i = 0; i < capacity; i++) {
-        int val = table[i].load(std::memory_order_relaxed);
-        if (val != EMPTY && val != TOMBSTONE) {
-            sum += val;  
-        }
-    }    
-    return sum;
+    // (parallel, vectorized: see parallelSum and sumLiveKeys in util.h)
+    return parallelSum(capacity, [&](int64_t begin, int64_t end) {
+        return sumLiveKeys((const int *) table.data(), begin, end, EMPTY, TOMBSTONE);
+    });
 }
 
 
@@ -1,13 +1,68 @@
 #pragma once
 #include "util.h"
+#include "reclaimer.h"
 #include <atomic>
 #include <cmath>
 #include <cassert>
+#include <vector>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
 #define EXPANSION_RATE 7
 #define TABLE_PARTITION_SIZE 4096
 const double EXPANSION_CAPACITY_TRIGGER = 0.85;
+// Shrink once the live keys fill less than this fraction of the table. A migration sizes the new
+// table at live*EXPANSION_RATE, so this only fires after the live set has halved since the last
+// resize, which keeps grow/shrink from flapping around either threshold.
+const double SHRINK_CAPACITY_TRIGGER = 0.5 / EXPANSION_RATE;
+
+// Tombstone purge mode: erases turn the tombstone they leave back into EMPTY when it ends a probe
+// cluster (see purgeTombstones), so churn with a steady live size stops triggering same-size
+// "expansions". Costs a few CAS per erase and a re-check per insert, so it is opt-in (make benchmark_purge).
+#ifndef PURGE_TOMBSTONES
+#define PURGE_TOMBSTONES 0
+#endif
+
+// Incremental resize mode: a migration is split into INCREMENTAL_CHUNK_SIZE-slot chunks and every
+// insert/erase moves at most INCREMENTAL_CHUNKS_PER_OP of them (plus its own probe path), so no
+// single operation pays for a whole table. Lookups read through to the old table meanwhile.
+// Opt-in (make benchmark_incremental): migrations take longer and more operations pay the read-through.
+#ifndef INCREMENTAL_RESIZE
+#define INCREMENTAL_RESIZE 0
+#endif
+#define INCREMENTAL_CHUNK_SIZE 64
+#define INCREMENTAL_CHUNKS_PER_OP 1
+
+#if INCREMENTAL_RESIZE && PURGE_TOMBSTONES
+#error "purge mode waits for whole migrations, so it cannot be combined with incremental resizing"
+#endif
+
+// Group probing mode: every table keeps a one-byte tag per slot in a separate array (0 until a key
+// lands in the slot, then 0x80 | 7 bits of the key's hash), and probes compare GROUP_WIDTH tags at a
+// time to skip the slots that certainly hold some other key. Opt-in (make benchmark_group): every
+// operation reads one more cache line, which only pays off once probe sequences get long.
+#ifndef GROUP_PROBING
+#define GROUP_PROBING 0
+#endif
+
+#if GROUP_PROBING && PURGE_TOMBSTONES
+#error "purge mode lets a slot hold a second key, whose tag could be read before it replaced the first one's"
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__AVX2__)
+#define GROUP_WIDTH 32
+#elif defined(__SSE2__)
+#define GROUP_WIDTH 16
+#else
+#define GROUP_WIDTH 8
+#endif
 
 // #define EXPANSION_RATE 7
 // #define TABLE_PARTITION_SIZE 4096
@@ -33,25 +88,104 @@ gdb ./benchmark.out -ex="set args -a D -sT 10000 -m 15000 -sR 1000000 -t 8"
 Scenarios:
 */
 
-struct PaddedInt64Atomic {
+// tag of a key with hash h (never 0, which marks a slot whose key, if any, has no tag yet)
+inline uint8_t groupTag(uint32_t h) {
+    return 0x80 | ((h * 0x9E3779B1u) >> 25);
+}
+
+// bit j is set if group[j] is tag or 0, i.e., if slot j may hold the key tag belongs to
+inline uint32_t groupCandidates(const uint8_t * group, uint8_t tag) {
+#if defined(__AVX2__)
+    __m256i g = _mm256_loadu_si256((const __m256i *) group);
+    __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(g, _mm256_set1_epi8(tag)), _mm256_cmpeq_epi8(g, _mm256_setzero_si256()));
+    return (uint32_t) _mm256_movemask_epi8(hit);
+#elif defined(__SSE2__)
+    __m128i g = _mm_loadu_si128((const __m128i *) group);
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(g, _mm_set1_epi8(tag)), _mm_cmpeq_epi8(g, _mm_setzero_si128()));
+    return (uint32_t) _mm_movemask_epi8(hit);
+#else
+    uint32_t ret = 0;
+    for (int j = 0; j < GROUP_WIDTH; j++) {
+        if (group[j] == tag || group[j] == 0) ret |= 1u << j;
+    }
+    return ret;
+#endif
+}
+
+/**
+ * Header of a snapshot file (AlgorithmD::saveSnapshot). The file is the table itself: the header, then the
+ * data array at dataOffset (page aligned, so it can be mapped in place), then, if the saving build used group
+ * probing, the tag array at tagOffset. Slots hold keys, EMPTY or TOMBSTONE (no migration marks).
+ */
+struct snapshotFileHeader {
+    char magic[8];              // SNAPSHOT_FILE_MAGIC
+    uint32_t version;
+    uint32_t keyBytes;          // sizeof(K)
+    int64_t empty;              // the sentinel encodings of the saving build...
+    int64_t tombstone;
+    int64_t markedMask;
+    uint32_t hashCheck;         // ... and its hash of SNAPSHOT_HASH_CHECK_KEY: keys are only where a build that
+    uint32_t probeIndexing;     //     hashes and indexes the same way looks for them
+    int64_t capacity;
+    int64_t liveKeys;
+    int64_t tombstones;
+    uint64_t dataOffset;
+    uint64_t tagOffset;         // 0: no tags
+    uint64_t fileBytes;
+    uint64_t checksum;          // sum over slots i of murmur3_64(slot ^ i * golden ratio)
+};
+#define SNAPSHOT_FILE_MAGIC "ALGDSNAP"
+#define SNAPSHOT_FILE_VERSION 1
+#define SNAPSHOT_FILE_ALIGNMENT 4096
+#define SNAPSHOT_HASH_CHECK_KEY 0x5EED
+#define SNAPSHOT_TAG_PADDING 64                                // >= GROUP_WIDTH of any build
+
+template <typename K>
+struct PaddedKeyAtomic {
     // Note that this is not 64 bytes int!
     // Padding makes the program so much slower!
-    std::atomic<int> v;
+    std::atomic<K> v;
+};
+
+/**
+ * Compile-time description of a key type: its reserved encodings and its hash.
+ * With these definitions, the "real" keys allowed in the table are [1, TOMBSTONE-1].
+ */
+template <typename K>
+struct keyTraits;
+
+template <>
+struct keyTraits<int32_t> {
+    static constexpr int32_t MARKED_MASK = (int32_t) 0x80000000;                // most significant bit of a 32-bit key
+    static constexpr int32_t TOMBSTONE = (int32_t) 0x7FFFFFFF;                  // largest value that doesn't use bit MARKED_MASK
+    static constexpr int32_t EMPTY = 0;
+    static inline uint32_t hash(const int32_t key) { return murmur3(key); }
+};
+
+template <>
+struct keyTraits<int64_t> {
+    static constexpr int64_t MARKED_MASK = (int64_t) 0x8000000000000000ULL;    // most significant bit of a 64-bit key
+    static constexpr int64_t TOMBSTONE = (int64_t) 0x7FFFFFFFFFFFFFFFULL;      // largest value that doesn't use bit MARKED_MASK
+    static constexpr int64_t EMPTY = 0;
+    // Probing works on 32-bit hashes either way (a 64-bit h makes the modulo noticeably slower)
+    static inline uint32_t hash(const int64_t key) { return (uint32_t) murmur3_64(key); }
 };
 
 
+template <typename K = int>
 class AlgorithmD {
 private:
-    enum {
-        MARKED_MASK = (int) 0x80000000,     // most significant bit of a 32-bit key
-        TOMBSTONE = (int) 0x7FFFFFFF,       // largest value that doesn't use bit MARKED_MASK
-        EMPTY = (int) 0
-    }; // with these definitions, the largest "real" key we allow in the table is 0x7FFFFFFE, and the smallest is 1 !!
+    typedef keyTraits<K> traits;
+    static constexpr K MARKED_MASK = traits::MARKED_MASK;
+    static constexpr K TOMBSTONE = traits::TOMBSTONE;
+    static constexpr K EMPTY = traits::EMPTY;
+    // A frozen tombstone during a migration; outside of one, an EMPTY slot held by purgeTombstones
+    static constexpr K PURGING = MARKED_MASK | TOMBSTONE;
+    static_assert(EMPTY == 0, "tables start out as zeroed memory (allocTableArray)");
 
     char padding2[PADDING_BYTES];
     int numThreads;
     int initCapacity; 
-    int tablePartitionSize = 4096;
     // more fields (pad as appropriate)
     char padding3[PADDING_BYTES];
 
@@ -66,9 +200,11 @@ private:
         // std::atomic<int> chunksDone;
 
         
-        alignas(PADDING_BYTES) PaddedInt64Atomic *data;         // Pointer to data array
+        alignas(PADDING_BYTES) PaddedKeyAtomic<K> *data;         // Pointer to data array
+        uint8_t *ctrl;                                         // Group probing: tag per data slot (+ GROUP_WIDTH bytes so a group load never runs off the end)
 
-        alignas(PADDING_BYTES) PaddedInt64Atomic *old;          // Pointer to old table (during expansion)
+        alignas(PADDING_BYTES) PaddedKeyAtomic<K> *old;          // Pointer to old table (during expansion)
+        uint8_t *oldCtrl;                                      // Its tags
 
         alignas(PADDING_BYTES) int capacity;                   // Current table capacity
         char padding2[PADDING_BYTES - sizeof(int)];
@@ -82,51 +218,93 @@ private:
         alignas(PADDING_BYTES) counter *tombStoneSize;            // Approximate size counter
         char padding7[PADDING_BYTES - sizeof(counter*)];
 
-        alignas(PADDING_BYTES) std::atomic<int> chunksClaimed; // Number of chunks claimed in migration
-        char padding5[PADDING_BYTES - sizeof(std::atomic<int>)];
+        alignas(PADDING_BYTES) chunkClaimer * chunks;          // Hands out the old table's chunks to the helpers (nullptr: no migration)
+        char padding5[PADDING_BYTES - sizeof(chunkClaimer*)];
 
-        alignas(PADDING_BYTES) std::atomic<int> chunksDone;    // Number of completed migrations
+        alignas(PADDING_BYTES) std::atomic<int> slotsLeft;     // Old slots not in their final state yet (0: migration complete)
         char padding6[PADDING_BYTES - sizeof(std::atomic<int>)];
 
+        alignas(PADDING_BYTES) int chunkSize;                  // Old slots per chunk (migrationChunkSlots), fixed at creation so all helpers agree
+        int totalOldChunks;
+        table * prev;                                          // Table we migrate from (retired once the migration is done)
+        std::atomic<char> * slotDone;                          // Per old slot: finished and counted (its key copied into data, or its tombstone left behind)
+        int64_t copyReserve;                                   // Slots kept free for the old keys until the migration is done (see expandAsNeeded)
+        char padding8[PADDING_BYTES - 2 * sizeof(int) - sizeof(table*) - sizeof(std::atomic<char>*) - sizeof(int64_t)];
+
+        alignas(PADDING_BYTES) void * mapping = nullptr;       // Snapshot file that data and ctrl live in (loadSnapshot), or nullptr
+        size_t mappingBytes = 0;
+
         // Constructor
-        table(int init_capacity, PaddedInt64Atomic* oldTableData)
-        : data(new PaddedInt64Atomic[init_capacity]),
+        table(int init_capacity, PaddedKeyAtomic<K>* oldTableData)
+        : data((PaddedKeyAtomic<K> *) allocTableArray((int64_t) init_capacity * sizeof(PaddedKeyAtomic<K>))),
+          ctrl(GROUP_PROBING ? (uint8_t *) allocTableArray(init_capacity + GROUP_WIDTH) : nullptr),
           old(oldTableData),
+          oldCtrl(nullptr),
           capacity(init_capacity), 
           oldCapacity(0),
-          chunksClaimed(0), 
-          chunksDone(0) 
+          chunks(nullptr),
+          slotsLeft(0),
+          chunkSize(TABLE_PARTITION_SIZE),
+          totalOldChunks(0),
+          prev(nullptr),
+          slotDone(nullptr),
+          copyReserve(0)
         {
-            // Initialize all data elements to EMPTY
-            for (int i = 0; i < capacity; i++) {
-                data[i].v.store(EMPTY, std::memory_order_relaxed);  // Initialize data to EMPTY
-            }
+            // (data starts out EMPTY: allocTableArray returns zeroed memory)
 
             // remember to intiate counter here too!
         }
 
-        // Copy constructor
-        table(const table& oldTable)
+        // Adopts the data (and tags) of a snapshot file mapped at _mapping; the table unmaps it when it is freed
+        table(void * _mapping, const snapshotFileHeader & header)
+        : data((PaddedKeyAtomic<K> *) ((char *) _mapping + header.dataOffset)),
+          ctrl(GROUP_PROBING ? (uint8_t *) _mapping + header.tagOffset : nullptr),
+          old(nullptr),
+          oldCtrl(nullptr),
+          capacity((int) header.capacity),
+          oldCapacity(0),
+          chunks(nullptr),
+          slotsLeft(0),
+          chunkSize(TABLE_PARTITION_SIZE),
+          totalOldChunks(0),
+          prev(nullptr),
+          slotDone(nullptr),
+          copyReserve(0),
+          mapping(_mapping),
+          mappingBytes(header.fileBytes)
+        {}
+
+        // Expansion constructor (also used to shrink: newCapacity may be below oldTable.capacity)
+        table(const table& oldTable, int numThreads, int newCapacity)
         {
-            // This copy constructor is for making new tables during expansion
+            // This constructor is for making new tables during expansion
             // capacity = (oldTable.approxSize) * EXPANSION_RATE;
             oldCapacity = oldTable.capacity;
-            capacity = std::max((int)(oldTable.approxSize->get() - oldTable.tombStoneSize->get()) * EXPANSION_RATE , oldCapacity);
-            // capacity = (oldTable.approxSize->get() - oldTable.tombStoneSize->get() * EXPANSION_RATE);
-            data = new PaddedInt64Atomic[capacity];
+            capacity = roundCapacity(newCapacity);
+            data = (PaddedKeyAtomic<K> *) allocTableArray((int64_t) capacity * sizeof(PaddedKeyAtomic<K>));   // (all EMPTY)
+            ctrl = GROUP_PROBING ? (uint8_t *) allocTableArray(capacity + GROUP_WIDTH) : nullptr;
             old = oldTable.data;
-            chunksClaimed = 0;
-            chunksDone = 0;
+            oldCtrl = oldTable.ctrl;
+            slotsLeft = oldCapacity;
+            chunkSize = INCREMENTAL_RESIZE ? INCREMENTAL_CHUNK_SIZE : migrationChunkSlots(oldCapacity, numThreads, sizeof(PaddedKeyAtomic<K>));
+            totalOldChunks = (oldCapacity + chunkSize - 1) / chunkSize;
+            chunks = new chunkClaimer(totalOldChunks, numThreads);
+            prev = const_cast<table*>(&oldTable);
+            slotDone = (std::atomic<char> *) allocTableArray(oldCapacity);    // (all 0)
+            copyReserve = 0;    // (set by startExpansion)
             // approxSize = new counter(numThreads);
-
-            for (int i = 0; i < capacity; i++) {
-                data[i].v.store(EMPTY, std::memory_order_relaxed);
-            }
         }
 
         // Destructor
         ~table() {
-            delete[] data;         // Clean up the data array
+            if (mapping) {
+                munmap(mapping, mappingBytes);
+            } else {
+                freeTableArray(data);  // Clean up the data array
+                freeTableArray(ctrl);
+            }
+            freeTableArray(slotDone);
+            delete chunks;
             // delete[] old;
             delete approxSize;     // Clean up the approxSize counter
             delete tombStoneSize;  // Clean up the tombStoneSize counter
@@ -136,67 +314,234 @@ private:
     char padding0[64];
     atomic<table *> currentTable;
     char padding1[64];
-    
-    int migrationCount = 0; 
+
+    EpochReclaimer<table> reclaimer;                           // Frees tables once no thread can still be reading them
+    char padding4[PADDING_BYTES];
+
+    std::atomic<int> migrationCount;                           // Tables installed by startExpansion
+    std::atomic<int> cleanupCount;                             // ... of which had the same capacity (pure tombstone cleanups)
+    std::atomic<int> shrinkCount;                              // ... of which were smaller than the table they replaced
+    std::atomic<int> snapshotCount;                            // ... of which were started by takeSnapshot
+    char padding5[PADDING_BYTES];
+    debugCounter purgedTombstones;
+    debugCounter copyHelps;                                    // Keys copied for a thread that froze them and had not finished the copy
+    debugCounter tableSetups;                                  // Tables built by startExpansion (including the ones that lost the race)
+    debugCounter tableSetupMicros;                             // ... and the time spent building them
+    std::atomic<int64_t> maxTableSetupMicros {0};
+    debugCounter chunkKeysCopied;                              // Keys that migrate() copied, chunk by chunk
+    debugCounter chunkNanos;                                   // ... and the time those chunks took
     
     bool expandAsNeeded(const int tid, table * t, int i);
+    // each of a fresh table's two counters gets half the distance to the expansion trigger
+    static int64_t expansionHeadroom(table * t) { return (int64_t) (t->capacity * EXPANSION_CAPACITY_TRIGGER) / 2; }
+    // room a new table keeps for the keys of the old one while they are copied (see startExpansion): the live
+    // keys, plus per thread an insert or copy not counted yet, an insert into the old table still to come,
+    // and an insert into the new one that passed expandAsNeeded already
+    int64_t copyReserveFor(int64_t liveKeys) const { return std::max<int64_t>(liveKeys, 0) + 3 * numThreads; }
     void helpExpansion(const int tid, table * t);
-    void startExpansion(const int tid, table * t);
+    bool startExpansion(const int tid, table * t, int newCapacity);
     void migrate(const int tid, table * t, int myChunk);
+    int migrateSlot(const int tid, table * t, int index, int * copied = nullptr);
+    void migrateProbePath(const int tid, table * t, uint32_t h);
+    bool copyMigratedKey(table * t, int oldIndex, const K & key);
+    void finishSlots(const int tid, table * t, int count);
+    void completeMigration(const int tid, table * t);
+    table * freezeForSnapshot(const int tid);
+    static uint64_t snapshotChecksum(const K * slots, int64_t capacity);
+    const void * homeSlot(const K & key);
+    int find(PaddedKeyAtomic<K> * data, uint8_t * ctrl, int capacity, const K & key);
+    static int nextCandidate(const uint8_t * ctrl, int capacity, uint32_t h, int i, uint8_t tag);
+    int purgeTombstones(table * t, int index);
+    bool validateInsert(const int tid, table * t, const K & key, uint32_t h, int i);
     
     
     
 public:
     AlgorithmD(const int _numThreads, const int _capacity);
     ~AlgorithmD();
-    bool insertIfAbsent(const int tid, const int & key, bool ExpansionMode);
-    bool erase(const int tid, const int & key);
-    AlgorithmD::table* createNewTableStruct(const int tid);
-    long getSumOfKeys();
+    bool insertIfAbsent(const int tid, const K & key, bool ExpansionMode = false);
+    bool erase(const int tid, const K & key);
+    bool contains(const int tid, const K & key);
+    int64_t bulkLoad(const int tid, const K * keys, int64_t n);
+    int insertBatch(const int tid, const K * keys, int n, bool * results);
+    int eraseBatch(const int tid, const K * keys, int n, bool * results);
+    int containsBatch(const int tid, const K * keys, int n, bool * results);
+    table* createNewTableStruct(const int tid);
+    int64_t getSumOfKeys();
+    template <typename Visit>
+    void forEachKey(const int tid, Visit visit);
+    int64_t sumKeys(const int tid);
+    class snapshot;
+    snapshot takeSnapshot(const int tid);
+    bool saveSnapshot(const int tid, const char * path);
+    bool loadSnapshot(const int tid, const char * path, bool verifyChecksum = false);
+    int64_t getResizeStamp(const int tid);
     void printDebuggingDetails(); 
-    void printTable(PaddedInt64Atomic* data, int capacity);
+    void printTable(PaddedKeyAtomic<K>* data, int capacity);
 
 };
 
+/**
+ * A read-only view of the set (AlgorithmD::takeSnapshot), which can be iterated any number of times while
+ * other threads keep updating the set.
+ *
+ * Taking one starts a same-size migration and completes it: afterwards every slot of the old table is
+ * frozen (MARKED_MASK), and a frozen slot never changes again, so the old table is the snapshot. Writers are
+ * not blocked: they work on the new table (they only help with the migration, as with any resize).
+ *
+ * Consistency: a snapshot contains every key that was in the set for the whole time takeSnapshot ran, and
+ * no key that was absent for that whole time; a key inserted or erased while it ran may or may not be in it
+ * (each slot is frozen at its own moment). Once taken, it never changes.
+ *
+ * The snapshot keeps its thread (tid) announced to the reclaimer, so no retired table is freed while it
+ * exists. The thread may keep using the table meanwhile (guards nest), but should not hold a snapshot longer
+ * than it needs to.
+ */
+template <typename K>
+class AlgorithmD<K>::snapshot {
+private:
+    EpochGuard<table> guard;        // first: the table must stay allocated until the snapshot is gone
+    const PaddedKeyAtomic<K> * data;
+    int capacity;
+
+    static K keyAt(const PaddedKeyAtomic<K> * data, int64_t i) {
+        K key = data[i].v.load(std::memory_order_relaxed) & ~MARKED_MASK;
+        return (key == TOMBSTONE) ? EMPTY : key;    // (a frozen tombstone, PURGING, is a tombstone too)
+    }
+public:
+    snapshot(AlgorithmD<K> & ds, const int tid) : guard(ds.reclaimer, tid) {
+        table * t = ds.freezeForSnapshot(tid);
+        data = t->data;
+        capacity = t->capacity;
+    }
+    snapshot(const snapshot &) = delete;
+    snapshot & operator=(const snapshot &) = delete;
+
+    // forward iterator over the keys: for (K key : snap) ...
+    class iterator {
+    private:
+        const PaddedKeyAtomic<K> * data;
+        int capacity;
+        int i;
+        void skipEmpty() { while (i < capacity && keyAt(data, i) == EMPTY) i++; }
+    public:
+        iterator(const PaddedKeyAtomic<K> * _data, int _capacity, int _i) : data(_data), capacity(_capacity), i(_i) { skipEmpty(); }
+        K operator*() const { return keyAt(data, i); }
+        iterator & operator++() { i++; skipEmpty(); return *this; }
+        bool operator!=(const iterator & other) const { return i != other.i; }
+    };
+    iterator begin() const { return iterator(data, capacity, 0); }
+    iterator end() const { return iterator(data, capacity, capacity); }
+
+    // calls visit(key) for every key, from several threads at once (see parallelFor in util.h)
+    template <typename Visit>
+    void forEach(Visit visit) const {
+        parallelFor(capacity, [&](int64_t begin, int64_t end) {
+            for (int64_t i = begin; i < end; i++) {
+                K key = keyAt(data, i);
+                if (key != EMPTY)
+                    visit(key);
+            }
+        });
+    }
+
+    int64_t getSumOfKeys() const {
+        return parallelSum(capacity, [&](int64_t begin, int64_t end) {
+            return sumLiveKeys((const K *) data, begin, end, EMPTY, TOMBSTONE, MARKED_MASK);
+        });
+    }
+};
+
 /**
  * constructor: initialize the hash table's internals
  * 
  * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
  * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
  */
-AlgorithmD::AlgorithmD(const int _numThreads, const int _capacity)
-: numThreads(_numThreads), initCapacity(_capacity) {
+template <typename K>
+AlgorithmD<K>::AlgorithmD(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), initCapacity(roundCapacity(_capacity)), reclaimer(_numThreads), migrationCount(0), cleanupCount(0), shrinkCount(0), snapshotCount(0) {
     // Check how to initialize the data[indexes] of a table to EMPTY here in the constructor
     table* initialTable = new table(initCapacity, nullptr);
-    initialTable->approxSize = new counter(numThreads);      // Initialize the counter for approximate size of inserts
-    initialTable->tombStoneSize = new counter(numThreads);   // Initialize the counter for approximate size of tombstones
-
-    // Setting partion size the same as the number of threads
-    int tablePartitionSize = _capacity / (_numThreads);
+    initialTable->approxSize = new counter(numThreads, expansionHeadroom(initialTable));      // Initialize the counter for approximate size of inserts
+    initialTable->tombStoneSize = new counter(numThreads, expansionHeadroom(initialTable));   // Initialize the counter for approximate size of tombstones
 
     // Set currentTable to the newly created table
     currentTable.store(initialTable, std::memory_order_acquire);
 }
 
 // destructor: clean up any allocated memory, etc.
-AlgorithmD::~AlgorithmD() {
+// (no thread may be inside an operation; tables retired earlier are freed by the reclaimer)
+template <typename K>
+AlgorithmD<K>::~AlgorithmD() {
+    table * t = currentTable.load();
+    if (t->slotsLeft.load() > 0)
+        delete t->prev;     // its migration never finished (incremental mode), so it was never retired
+    delete t;
 }
 
-bool AlgorithmD::expandAsNeeded(const int tid, table * t, int i) {
+template <typename K>
+bool AlgorithmD<K>::expandAsNeeded(const int tid, table * t, int i) {
     
-    helpExpansion(tid, t);
+    // (incremental mode: help once per operation, not on every probe step)
+    if (!INCREMENTAL_RESIZE || i == 0)
+        helpExpansion(tid, t);
 
     // printf("Approx Size: %ld, Tombstone Size: %ld, Capacity: %d\n", t->approxSize->get(), t->tombStoneSize->get(), t->capacity);
 
+    int64_t approx = t->approxSize->get();
+    int64_t tombs = t->tombStoneSize->get();
+    int64_t error = t->approxSize->errorBound() + t->tombStoneSize->errorBound();
+    int64_t trigger = t->capacity * EXPANSION_CAPACITY_TRIGGER;
+    // (while t's migration runs, the old keys it has yet to copy need room too)
+    bool migrating = t->slotsLeft.load() > 0;
+    int64_t due = migrating ? trigger - t->copyReserve : trigger;
+
+    // The global counts lag the truth by at most error. Within that distance of the trigger, read
+    // every thread's share (once per operation) so the resize starts when the table really is that full.
+    if (i == 0 && approx + tombs + error >= due) {
+        approx = t->approxSize->getAccurate();
+        tombs = t->tombStoneSize->getAccurate();
+        error = 0;
+    }
+
+    // t's counters only reach their real values once every copy has landed, so the next resize
+    // waits for the current one to complete (this also keeps copies from landing in frozen slots).
+    // The threads holding the last chunks may be descheduled for as long as it takes t to fill up,
+    // though, so once only the copies' room is left this thread finishes the migration itself (and
+    // looks again, with the copies counted).
+    if (migrating) {
+        if (approx + tombs < due)
+            return false;
+        completeMigration(tid, t);
+        return expandAsNeeded(tid, t, i);
+    }
 
-    if (t->approxSize->get() + t->tombStoneSize->get() >= t->capacity * EXPANSION_CAPACITY_TRIGGER
+    if (approx + tombs >= trigger
         // || (i > 10 && t->approxSize->getAccurate() >= triggerPoint)
     ){
     // printf("Approx Size: %ld, Tombstone Size: %ld, Capacity: %d\n", t->approxSize->get(), t->tombStoneSize->get(), t->capacity);
         // printf("A - %ld \n", t->approxSize->get());
-        startExpansion(tid, t);
+        startExpansion(tid, t, std::max((int)(approx - tombs) * EXPANSION_RATE, t->capacity));
         return true;
     }
+
+    // Flush less often the further the table is from the trigger (both counters add up to the trigger value)
+    if (i == 0) {
+        t->approxSize->setHeadroom((trigger - approx - tombs) / 2);
+        t->tombStoneSize->setHeadroom((trigger - approx - tombs) / 2);
+    }
+
+    // Shrink (checked once per operation): size the new table from an upper bound on the live keys.
+    // (and no smaller than the copies' room needs, see startExpansion)
+    if (i == 0 && t->capacity > initCapacity) {
+        int64_t liveUpper = approx - tombs + error;
+        int64_t wanted = std::max<int64_t>(liveUpper * EXPANSION_RATE, copyReserveFor(liveUpper) / EXPANSION_CAPACITY_TRIGGER + 1);
+        if (liveUpper < t->capacity * SHRINK_CAPACITY_TRIGGER && wanted < t->capacity) {
+            startExpansion(tid, t, std::max((int) wanted, initCapacity));
+            return true;
+        }
+    }
     // else if (i > 10 && t->approxSize->getAccurate() + t->tombStoneSize->getAccurate() >= t->capacity * EXPANSION_CAPACITY_TRIGGER){
     //     startExpansion(tid, t);
     //     return true;
@@ -208,85 +553,96 @@ bool AlgorithmD::expandAsNeeded(const int tid, table * t, int i) {
     return false;
 }
 
-void AlgorithmD::helpExpansion(const int tid, table * t) {
+template <typename K>
+void AlgorithmD<K>::helpExpansion(const int tid, table * t) {
 
-    int totalOldChunks = ceil((float)t->oldCapacity / (tablePartitionSize));
-    // printf("Total Old Chunks: %d\n", totalOldChunks);
+    // (no migration: a table that no migration created, the first one or a bulk-loaded one, or one whose
+    // migration is done; completeMigration may have finished it with chunks left unclaimed)
+    if (!t->chunks || t->slotsLeft.load() == 0)
+        return;
     // printf("Old Capacity: %d\n", t->oldCapacity);
 
     // printf(" Migration TID=%d\n",tid);
-    bool flag = false;
-    
-    while (t->chunksClaimed < totalOldChunks) {
-        flag = true;
-        // printf("helpExpansion's inside touched\n");
-        int myChunk = t->chunksClaimed.fetch_add(1) + 1;
+    int myChunk;
+    for (int claims = 0; (!INCREMENTAL_RESIZE || claims < INCREMENTAL_CHUNKS_PER_OP) && (myChunk = t->chunks->claim(tid)) >= 0; claims++) {
         // printf("Migration TID=%d, myChunk=%d\n",tid ,myChunk);
-
-        // printf("ChunksClaimed Org: %d\n", t->chunksClaimed.load());
-        // printf("MyChunk: %d", myChunk);
-        if (myChunk <= totalOldChunks) {
-            // printf("Migrate touched - chunk #%d\n", myChunk);
-            migrate(tid, t, myChunk);
-            t->chunksDone.fetch_add(1);
-        }
-        // printf("Claimed:%d, ChunksDone:%d", t->chunksClaimed.load(), t->chunksDone.load());
+        migrate(tid, t, myChunk);
     }
-    while (t->chunksDone < totalOldChunks){
+    // No waiting for the chunks other threads are still moving: an operation that needs part of
+    // the old table first moves that part itself (migrateProbePath). Purge mode cannot do that, since
+    // a purge can open a hole that lets an old insert land beyond the end of a probe path.
+    while (PURGE_TOMBSTONES && t->slotsLeft > 0){
         // printf("TID: %d \n", tid);
     }
-    // if (flag)
-    //     printf("Migration Done, New Table Size: %d, Old Table Size: %d\n", t->capacity, t->oldCapacity);
     // printf("Old table: TID: %d \n", tid);
     // printTable(t->old, t->oldCapacity);
 }
 
-void AlgorithmD::startExpansion(const int tid, table *t) {
+// returns true if this call installed the new table
+template <typename K>
+bool AlgorithmD<K>::startExpansion(const int tid, table *t, int newCapacity) {
     // printf("Touched\n");
+    bool installed = false;
     if (currentTable == t){
         // printf("Touched 2\n");
-        table* t_new = new table(*t); 
-        t_new->approxSize = new counter(numThreads);
-        t_new->tombStoneSize = new counter(numThreads);
-
-
-        if (currentTable.compare_exchange_strong(t, t_new)){
-            // delete t_new;
-            tablePartitionSize = t_new->capacity / (numThreads);
+        auto setupStart = std::chrono::steady_clock::now();
+        table* t_new = new table(*t, numThreads, newCapacity);
+        t_new->approxSize = new counter(numThreads, expansionHeadroom(t_new));
+        t_new->tombStoneSize = new counter(numThreads, expansionHeadroom(t_new));
+        int64_t setupMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - setupStart).count();
+        tableSetups.inc(tid);
+        tableSetupMicros.add(tid, setupMicros);
+        for (int64_t seen = maxTableSetupMicros.load(); setupMicros > seen && !maxTableSetupMicros.compare_exchange_weak(seen, setupMicros); ) {}
+
+        // t's live keys are read right before t_new is installed (tombstones first, so an erase in between only
+        // adds to the count): t can have filled up since newCapacity was chosen, if we were descheduled, and a
+        // shrink that no longer has room for t's keys is dropped.
+        int64_t oldTombs = t->tombStoneSize->getAccurate();
+        t_new->copyReserve = copyReserveFor(t->approxSize->getAccurate() - oldTombs);
+        bool roomForOldKeys = t_new->capacity >= t->capacity || t_new->copyReserve < t_new->capacity * EXPANSION_CAPACITY_TRIGGER;
+
+        if (!roomForOldKeys || !currentTable.compare_exchange_strong(t, t_new)){
+            delete t_new;   // never published, so it can be freed right away
         }
-        else{
-            t_new->~table();
+        else {
+            installed = true;
+            migrationCount++;
+            if (t_new->capacity == t_new->oldCapacity)
+                cleanupCount++;
+            else if (t_new->capacity < t_new->oldCapacity)
+                shrinkCount++;
         }
     }
     helpExpansion(tid, currentTable);
+    return installed;
 }
 
-void AlgorithmD::migrate(const int tid, table * t, int myChunk) {
-    int start = ((myChunk - 1) * tablePartitionSize);
-    int end = min(start + tablePartitionSize, t->oldCapacity); 
+template <typename K>
+void AlgorithmD<K>::migrate(const int tid, table * t, int myChunk) {
+    int start = myChunk * t->chunkSize;
+    int end = min(start + t->chunkSize, t->oldCapacity); 
 
-    bool migrated = false;  
     // printf("Migrating Chunk: %d, TID: %d\n", myChunk, tid);
+    auto chunkStart = std::chrono::steady_clock::now();
+    int finalized = 0;
+    int copied = 0;
+    auto old = t->old;
     for (int i = start; i < end; i++) {
-        migrated = true;
-        // printf("TID:%d, Migrating index number: %d", tid, i);
-        int key = t->old[i].v.load();
-
-        if (key == TOMBSTONE)
-            continue;
-
-        if (!(t->old[i].v.compare_exchange_strong(key, key | MARKED_MASK))){
-            i--;
-            // printf("Noooooo!\n");
-            continue;
-        }
-        
-        if (key != EMPTY && key != TOMBSTONE) {  // Only migrate valid keys
-            // Insert into the new table (disable expansion)
-            bool MigrateDone = insertIfAbsent(tid, key, true);
-            assert(MigrateDone);
+        // the new-table slot of the key BATCH_PREFETCH_DISTANCE slots ahead, so its cache miss overlaps our copies
+        if (i + BATCH_PREFETCH_DISTANCE < end) {
+            K ahead = old[i + BATCH_PREFETCH_DISTANCE].v.load(std::memory_order_relaxed);
+            if (ahead != EMPTY && ahead != TOMBSTONE && !(ahead & MARKED_MASK)) {
+                int home = probeIndex(traits::hash(ahead), 0, t->capacity);
+                __builtin_prefetch(&t->data[home], 1);
+                if (GROUP_PROBING)
+                    __builtin_prefetch(&t->ctrl[home], 1);
+            }
         }
+        finalized += migrateSlot(tid, t, i, &copied);
     }
+    finishSlots(tid, t, finalized);
+    chunkKeysCopied.add(tid, copied);
+    chunkNanos.add(tid, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - chunkStart).count());
 
     // migrationCount += 1;
 
@@ -298,17 +654,384 @@ void AlgorithmD::migrate(const int tid, table * t, int myChunk) {
     // }
 }
 
-bool AlgorithmD::insertIfAbsent(const int tid, const int& key, bool ExpansionMode=false) {
+/**
+ * Brings old slot index into its final state. Any thread may finish any slot, since the one migrating
+ * its chunk may be descheduled for a long time: a tombstone, or a key that is frozen already (by a thread
+ * that may not have finished copying it), is finished by whichever thread sets slotDone first, and a key
+ * is copied before that by every thread that gets here (copyMigratedKey makes the extra copies no-ops).
+ *
+ * @param copied if given, incremented for a copied key (the chunk statistics)
+ * @return 1 if this call finished the slot (the caller reports it to finishSlots), else 0
+ */
+template <typename K>
+int AlgorithmD<K>::migrateSlot(const int tid, table * t, int index, int * copied) {
+    while (true) {
+        K key = t->old[index].v.load();
+
+        if (key == PURGING) {
+            // An erase holds this EMPTY slot while it purges the tombstone before it: freeze it as EMPTY
+            K expected = PURGING;
+            if (t->old[index].v.compare_exchange_strong(expected, MARKED_MASK))
+                return 1;
+            continue;
+        }
+        if (key == MARKED_MASK)
+            return 0;   // a frozen EMPTY, finished by the CAS that froze it
+
+        bool frozeIt = false;
+        // (without purging nothing ever writes a tombstone again, so it needs no freezing; with purging,
+        // tombstones are frozen too, so no erase can turn them into EMPTY behind the migration)
+        if (PURGE_TOMBSTONES || (key != TOMBSTONE && !(key & MARKED_MASK))) {
+            if (key & MARKED_MASK)
+                return 0;   // (purge mode) whoever froze it finishes it
+            if (!(t->old[index].v.compare_exchange_strong(key, key | MARKED_MASK)))
+                continue;
+            if (key == EMPTY || key == TOMBSTONE)
+                return 1;
+            if (PURGE_TOMBSTONES) {
+                // (with purging, a key can be in the old table twice when an insert lost a race with a purge,
+                // see validateInsert, so the copy needs the full insert and its duplicate check)
+                insertIfAbsent(tid, key, true);
+                t->slotDone[index].store(1, std::memory_order_release);
+                if (copied)
+                    (*copied)++;
+                return 1;
+            }
+            frozeIt = true;
+        }
+
+        key &= ~MARKED_MASK;
+        if (t->slotDone[index].load(std::memory_order_acquire))
+            return 0;
+        if (key != TOMBSTONE && !copyMigratedKey(t, index, key)) {
+            fprintf(stderr, "ERROR: no room left in the new table for a key of the old one (capacity %d)\n", t->capacity);
+            abort();
+        }
+        char expected = 0;
+        if (!t->slotDone[index].compare_exchange_strong(expected, 1))
+            return 0;
+        if (key != TOMBSTONE) {
+            // (counted right away: a count held back for the end of a chunk would be missing from
+            // approxSize for as long as this thread is descheduled, even once the migration is done)
+            t->approxSize->inc(tid);
+            if (!frozeIt)
+                copyHelps.inc(tid);
+            if (copied)
+                (*copied)++;
+        }
+        return 1;
+    }
+}
+
+/**
+ * Copies key, frozen in old slot oldIndex, into t->data: into the first EMPTY slot of its probe sequence,
+ * unless a copy of it is there already. This is insertIfAbsent without the parts a migrated key does not
+ * need: old keys are unique, no operation puts key into t->data before slotDone[oldIndex] is set (they
+ * first finish key's probe path in the old table, see migrateProbePath), the room for the copies is kept
+ * free (see copyReserve), and the caller updates approxSize.
+ *
+ * Several threads can copy the same key at once (see migrateSlot), and it still lands once: t->data slots
+ * only go from EMPTY to taken (to TOMBSTONE), so the copies all stop at the first copy's slot or take the
+ * same EMPTY slot by CAS. The one exception is a copy so late that key was copied, finished and erased
+ * from t->data behind it; such a copy has probed past that erase's tombstone, which the erase left only
+ * after slotDone was set, so the check before the CAS turns it back.
+ * (Not for purge mode, where a purge can turn a tombstone back into EMPTY.)
+ *
+ * @return false if t->data has no room left for key
+ */
+template <typename K>
+bool AlgorithmD<K>::copyMigratedKey(table * t, int oldIndex, const K & key) {
+    uint32_t h = traits::hash(key);
+    uint8_t tag = groupTag(h);
+    auto data = t->data;
+    int capacity = t->capacity;
+    for (int i = 0; i < capacity; i++) {
+        if (GROUP_PROBING && (i = nextCandidate(t->ctrl, capacity, h, i, tag)) == capacity)
+            break;
+        int index = probeIndex(h, i, capacity);
+        K found = data[index].v.load(std::memory_order_acquire);
+        // (a finished migration lets the next one freeze t, so a late copy can find key marked)
+        if ((found & ~MARKED_MASK) == key)
+            return true;
+        if (found != EMPTY)
+            continue;
+        if (t->slotDone[oldIndex].load())
+            return true;    // copied by another thread (and maybe erased since)
+        K expected = EMPTY;
+        if (data[index].v.compare_exchange_strong(expected, key)) {
+            if (GROUP_PROBING)
+                __atomic_store_n(&t->ctrl[index], tag, __ATOMIC_RELEASE);
+            return true;
+        }
+        if (expected == key)
+            return true;
+    }
+    // (a late copy can also find every slot taken or frozen once the migration is done)
+    return t->slotDone[oldIndex].load() != 0;
+}
+
+/**
+ * Called before an operation on a key with hash h works in t->data while t's migration is running.
+ * Finishes every old slot on the key's probe path, up to the first (now frozen) EMPTY, so no operation
+ * still working in the old table can change whether the key is there, and a copy of it is in t->data.
+ */
+template <typename K>
+void AlgorithmD<K>::migrateProbePath(const int tid, table * t, uint32_t h) {
+    int finalized = 0;
+    for (int j = 0; j < t->oldCapacity; j++) {
+        int index = probeIndex(h, j, t->oldCapacity);
+        finalized += migrateSlot(tid, t, index);
+        if (t->old[index].v.load() == MARKED_MASK)
+            break;
+    }
+    finishSlots(tid, t, finalized);
+}
+
+// Freezes the current table for a snapshot with a same-size migration, and returns it once nothing will write
+// it again. The caller holds an EpochGuard (the table is retired as soon as that migration is done).
+template <typename K>
+typename AlgorithmD<K>::table * AlgorithmD<K>::freezeForSnapshot(const int tid) {
+    table * t = currentTable.load();
+    // t may only be replaced once its own migration has landed (see expandAsNeeded)
+    completeMigration(tid, t);
+    if (startExpansion(tid, t, t->capacity))
+        snapshotCount++;
+    // If another resize replaced t first, t is frozen all the same once that migration is done; and if
+    // the table after it has been replaced too, that migration is done already.
+    table * next = currentTable.load();
+    if (next->prev == t)
+        completeMigration(tid, next);
+    return t;
+}
+
+// semantics: a snapshot of the set, see class snapshot
+template <typename K>
+typename AlgorithmD<K>::snapshot AlgorithmD<K>::takeSnapshot(const int tid) {
+    return snapshot(*this, tid);
+}
+
+template <typename K>
+uint64_t AlgorithmD<K>::snapshotChecksum(const K * slots, int64_t capacity) {
+    std::atomic<uint64_t> checksum(0);
+    parallelFor(capacity, [&](int64_t begin, int64_t end) {
+        uint64_t chunkSum = 0;      // (unsigned: wraps around)
+        for (int64_t i = begin; i < end; i++) {
+            chunkSum += murmur3_64((uint64_t) slots[i] ^ ((uint64_t) i * 0x9E3779B97F4A7C15ULL));
+        }
+        checksum.fetch_add(chunkSum, std::memory_order_relaxed);
+    });
+    return checksum.load();
+}
+
+/**
+ * Writes a snapshot (see takeSnapshot) of the set to path, in a format that loadSnapshot maps in place:
+ * see snapshotFileHeader. Other threads may keep using the set meanwhile. The file is written under a
+ * temporary name, synced, then renamed to path, so path never holds a partial snapshot.
+ * @return false if the file could not be written
+ */
+template <typename K>
+bool AlgorithmD<K>::saveSnapshot(const int tid, const char * path) {
+    static_assert(sizeof(PaddedKeyAtomic<K>) == sizeof(K), "the file is the data array");
+    EpochGuard<table> guard(reclaimer, tid);
+    table * t = freezeForSnapshot(tid);
+    int64_t capacity = t->capacity;
+
+    snapshotFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_FILE_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_FILE_VERSION;
+    header.keyBytes = sizeof(K);
+    header.empty = EMPTY;
+    header.tombstone = TOMBSTONE;
+    header.markedMask = MARKED_MASK;
+    header.hashCheck = traits::hash(SNAPSHOT_HASH_CHECK_KEY);
+    header.probeIndexing = PROBE_INDEXING;
+    header.capacity = capacity;
+    auto alignUp = [](uint64_t bytes) { return (bytes + SNAPSHOT_FILE_ALIGNMENT - 1) / SNAPSHOT_FILE_ALIGNMENT * SNAPSHOT_FILE_ALIGNMENT; };
+    header.dataOffset = alignUp(sizeof(header));
+    header.tagOffset = GROUP_PROBING ? alignUp(header.dataOffset + capacity * sizeof(K)) : 0;
+    header.fileBytes = GROUP_PROBING ? header.tagOffset + capacity + SNAPSHOT_TAG_PADDING : header.dataOffset + capacity * sizeof(K);
+
+    std::string tmpPath = std::string(path) + ".tmp";
+    int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    void * file = MAP_FAILED;
+    if (ftruncate(fd, header.fileBytes) == 0)
+        file = mmap(nullptr, header.fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (file == MAP_FAILED) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    // copy the frozen slots without their marks (a frozen tombstone, PURGING, becomes TOMBSTONE)
+    K * slots = (K *) ((char *) file + header.dataOffset);
+    uint8_t * tags = (uint8_t *) file + header.tagOffset;
+    std::atomic<int64_t> liveKeys(0), tombstones(0);
+    parallelFor(capacity, [&](int64_t begin, int64_t end) {
+        auto data = t->data;
+        int64_t chunkLive = 0, chunkTombstones = 0;
+        for (int64_t i = begin; i < end; i++) {
+            K key = data[i].v.load(std::memory_order_relaxed) & ~MARKED_MASK;
+            slots[i] = key;
+            if (key == TOMBSTONE) {
+                chunkTombstones++;
+            } else if (key != EMPTY) {
+                chunkLive++;
+                if (GROUP_PROBING)
+                    tags[i] = groupTag(traits::hash(key));
+            }
+        }
+        liveKeys.fetch_add(chunkLive, std::memory_order_relaxed);
+        tombstones.fetch_add(chunkTombstones, std::memory_order_relaxed);
+    });
+    header.liveKeys = liveKeys.load();
+    header.tombstones = tombstones.load();
+    header.checksum = snapshotChecksum(slots, capacity);
+    memcpy(file, &header, sizeof(header));
+
+    bool ok = (munmap(file, header.fileBytes) == 0);
+    ok = (fsync(fd) == 0) && ok;
+    ok = (close(fd) == 0) && ok;
+    ok = ok && (rename(tmpPath.c_str(), path) == 0);
+    if (!ok)
+        unlink(tmpPath.c_str());
+    return ok;
+}
+
+/**
+ * Fills an EMPTY set (nobody else may use it until loadSnapshot returns, as with bulkLoad) with a snapshot
+ * that saveSnapshot wrote to path.
+ *
+ * If the file was written by a build that places keys the same way (same hash, probe indexing and, for
+ * group probing, tags), its data array becomes the table as is: the file is mapped copy-on-write, pages are
+ * read on first touch, and the first write to a page copies it (the file itself never changes). Otherwise
+ * the keys are read from the mapping and bulk loaded (rehashed).
+ *
+ * @param verifyChecksum check the file against its checksum first (reads all of it)
+ * @return false if the file cannot be read, is not a snapshot of this key type, or fails the checksum
+ */
+template <typename K>
+bool AlgorithmD<K>::loadSnapshot(const int tid, const char * path, bool verifyChecksum) {
+    table * old = currentTable.load();
+    assert(old->slotsLeft.load() == 0 && old->approxSize->getAccurate() == 0);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    snapshotFileHeader header;
+    struct stat st;
+    bool valid = fstat(fd, &st) == 0
+            && pread(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header)
+            && !memcmp(header.magic, SNAPSHOT_FILE_MAGIC, sizeof(header.magic))
+            && header.version == SNAPSHOT_FILE_VERSION
+            && header.keyBytes == sizeof(K)
+            && header.empty == EMPTY && header.tombstone == TOMBSTONE && header.markedMask == MARKED_MASK
+            && header.capacity > 0 && header.capacity <= (1 << 30)
+            && header.dataOffset % SNAPSHOT_FILE_ALIGNMENT == 0
+            && header.dataOffset <= header.fileBytes && header.capacity * sizeof(K) <= header.fileBytes - header.dataOffset
+            // (group probing reads tags, and GROUP_WIDTH bytes past the last one, from a file that has them)
+            && (header.tagOffset == 0 || (header.tagOffset % SNAPSHOT_FILE_ALIGNMENT == 0 && header.tagOffset <= header.fileBytes
+                                          && header.capacity + SNAPSHOT_TAG_PADDING <= header.fileBytes - header.tagOffset))
+            && header.fileBytes == (uint64_t) st.st_size;
+    // (MAP_PRIVATE: our writes go to private copies of the pages they touch)
+    void * file = valid ? mmap(nullptr, header.fileBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (file == MAP_FAILED)
+        return false;
+    K * slots = (K *) ((char *) file + header.dataOffset);
+    if (verifyChecksum && snapshotChecksum(slots, header.capacity) != header.checksum) {
+        munmap(file, header.fileBytes);
+        return false;
+    }
+
+    bool samePlacement = header.hashCheck == traits::hash(SNAPSHOT_HASH_CHECK_KEY)
+            && header.probeIndexing == PROBE_INDEXING
+            && header.capacity == roundCapacity((int) header.capacity)
+            && (!GROUP_PROBING || header.tagOffset != 0);
+    if (!samePlacement) {
+        std::vector<K> keys;
+        keys.reserve(header.liveKeys);
+        for (int64_t i = 0; i < header.capacity; i++) {
+            if (slots[i] != EMPTY && slots[i] != TOMBSTONE)
+                keys.push_back(slots[i]);
+        }
+        munmap(file, header.fileBytes);
+        bulkLoad(tid, keys.data(), keys.size());
+        return true;
+    }
+
+    table * t = new table(file, header);
+    t->approxSize = new counter(numThreads, expansionHeadroom(t));
+    t->tombStoneSize = new counter(numThreads, expansionHeadroom(t));
+    t->approxSize->add(tid, header.liveKeys);
+    t->tombStoneSize->add(tid, header.tombstones);
+    currentTable.store(t, std::memory_order_release);
+    reclaimer.retire(tid, old);
+    return true;
+}
+
+// Moves whatever is left of t's migration into t (freezing and copying the slots nobody has finished yet,
+// including copies that other threads started), so t alone holds every key, and marks the migration done
+// even if threads that finished slots before have not reported them yet. The caller holds an EpochGuard.
+template <typename K>
+void AlgorithmD<K>::completeMigration(const int tid, table * t) {
+    if (t->slotsLeft.load() == 0)
+        return;
+    for (int i = 0; i < t->oldCapacity; i++) {
+        migrateSlot(tid, t, i);
+    }
+    // (purge mode: only the thread that froze a key copies it, so wait for the copies in flight)
+    for (int i = 0; PURGE_TOMBSTONES && i < t->oldCapacity; i++) {
+        K key = t->old[i].v.load() & ~MARKED_MASK;
+        if (key != EMPTY && key != TOMBSTONE) {
+            while (!t->slotDone[i].load(std::memory_order_acquire)) {}
+        }
+    }
+    finishSlots(tid, t, t->oldCapacity);
+}
+
+template <typename K>
+void AlgorithmD<K>::finishSlots(const int tid, table * t, int count) {
+    // (completeMigration sets slotsLeft to 0 when every slot is done, so counts reported after that are dropped)
+    int left = t->slotsLeft.load();
+    while (count > 0 && left > 0) {
+        if (t->slotsLeft.compare_exchange_weak(left, std::max(left - count, 0))) {
+            if (left <= count) {
+                // Last old slot done: nobody will read the old table through t again
+                reclaimer.retire(tid, t->prev);
+            }
+            return;
+        }
+    }
+}
+
+template <typename K>
+bool AlgorithmD<K>::insertIfAbsent(const int tid, const K& key, bool ExpansionMode) {
+    EpochGuard<table> guard(reclaimer, tid);
     table* t = currentTable;
-    uint32_t h = murmur3(key);
+    uint32_t h = traits::hash(key);
+    uint8_t tag = groupTag(h);
+    if (GROUP_PROBING)
+        __builtin_prefetch(&t->data[probeIndex(h, 0, t->capacity)]);
+
+    if (!ExpansionMode && !PURGE_TOMBSTONES && t->slotsLeft.load() > 0)
+        migrateProbePath(tid, t, h);    // (if key is in the old table, t->data has its copy now)
 
     for (int i = 0; i < t->capacity; i++) {
         if (!ExpansionMode && expandAsNeeded(tid, t, i)) 
             return insertIfAbsent(tid, key);
+        if (GROUP_PROBING && (i = nextCandidate(t->ctrl, t->capacity, h, i, tag)) == t->capacity)
+            break;
 
-        int index = (h + i) % t->capacity;
-        int found = t->data[index].v.load(); 
+        int index = probeIndex(h, i, t->capacity);
+        K found = t->data[index].v.load(); 
 
+        if (!ExpansionMode && found == PURGING && currentTable == t) {
+            i = -1;     // the tombstone before this slot is being purged: probe again from the start
+            continue;
+        }
         if (!ExpansionMode && (found & MARKED_MASK)) {
             // printf("Marked Cell cathed in Insert\n");
             return insertIfAbsent(tid, key);
@@ -317,14 +1040,22 @@ bool AlgorithmD::insertIfAbsent(const int tid, const int& key, bool ExpansionMod
             return false;
         } 
         else if (found == EMPTY) {
-            int expected = EMPTY;
+            K expected = EMPTY;
             if (t->data[index].v.compare_exchange_strong(expected, key)) {
+                if (GROUP_PROBING)
+                    __atomic_store_n(&t->ctrl[index], tag, __ATOMIC_RELEASE);
                 t->approxSize->inc(tid);
                 // printf("inc\n");
+                if (PURGE_TOMBSTONES && !ExpansionMode && i > 0)
+                    return validateInsert(tid, t, key, h, i);
                 return true;
             } else {
                 // printf("Changed?!\n");
                 found = t->data[index].v;
+                if (!ExpansionMode && found == PURGING && currentTable == t) {
+                    i = -1;
+                    continue;
+                }
                 if (!ExpansionMode && (found & MARKED_MASK)) {
                     // printf("Edge case catched.\n");
                     return insertIfAbsent(tid, key);
@@ -338,21 +1069,35 @@ bool AlgorithmD::insertIfAbsent(const int tid, const int& key, bool ExpansionMod
     return false;
 }
 
-bool AlgorithmD::erase(const int tid, const int& key) {
+template <typename K>
+bool AlgorithmD<K>::erase(const int tid, const K& key) {
+    EpochGuard<table> guard(reclaimer, tid);
     table* t = currentTable.load();
-    uint32_t h = murmur3(key);
+    uint32_t h = traits::hash(key);
+    uint8_t tag = groupTag(h);
+    if (GROUP_PROBING)
+        __builtin_prefetch(&t->data[probeIndex(h, 0, t->capacity)]);
+
+    if (!PURGE_TOMBSTONES && t->slotsLeft.load() > 0)
+        migrateProbePath(tid, t, h);    // (if key is in the old table, it is erased from its copy in t->data)
 
     for (int i = 0; i < t->capacity; i++) {
         if (expandAsNeeded(tid, t, i)) 
             return erase(tid, key);
+        if (GROUP_PROBING && (i = nextCandidate(t->ctrl, t->capacity, h, i, tag)) == t->capacity)
+            break;
 
-        int index = (h + i) % t->capacity;
+        int index = probeIndex(h, i, t->capacity);
         // int found = t->data[index].v.load(std::memory_order_relaxed);
-        int found = t->data[index].v;
+        K found = t->data[index].v;
 
 
         // printf("Found: %d, MASK:%d\n", found, MARKED_MASK);
         
+        if (found == PURGING && currentTable == t) {
+            i = -1;     // the tombstone before this slot is being purged: probe again from the start
+            continue;
+        }
         if (found & MARKED_MASK){
             // printf("Marked Cell cathed in Insert");
             return erase(tid, key);
@@ -365,14 +1110,29 @@ bool AlgorithmD::erase(const int tid, const int& key) {
         // printf("A");
         if (found == key) {
             // printf("B");
-            int expected = key;
+            K expected = key;
             if (t->data[index].v.compare_exchange_strong(expected, TOMBSTONE)) {
-                t->tombStoneSize->inc(tid);
+                int purged = PURGE_TOMBSTONES ? purgeTombstones(t, index) : 0;
+                if (purged == 0) {
+                    t->tombStoneSize->inc(tid);
+                } else {
+                    // our own tombstone never counted; the older ones did, and their slots count as used
+                    t->approxSize->dec(tid);
+                    for (int j = 1; j < purged; j++) {
+                        t->approxSize->dec(tid);
+                        t->tombStoneSize->dec(tid);
+                    }
+                    purgedTombstones.add(tid, purged);
+                }
                 // printf("C!!\n");
                 return true;
             } 
             else {
                 found = t->data[index].v.load();
+                if (found == PURGING && currentTable == t) {
+                    i = -1;
+                    continue;
+                }
                 if (found & MARKED_MASK)
                     return erase(tid, key);
                 else if (found == TOMBSTONE || found == EMPTY)
@@ -384,30 +1144,393 @@ bool AlgorithmD::erase(const int tid, const int& key) {
     return false;
 }
 
+/**
+ * Tombstone purge. A tombstone whose next slot is EMPTY ends its probe cluster, so no probe
+ * sequence needs it and it can become EMPTY again. To clear slot index, we first hold the next
+ * slot (EMPTY -> PURGING) so no insert lands there meanwhile, clear the tombstone, and release
+ * the next slot. Then we go on backward, since the previous slot may now end the cluster.
+ *
+ * An insert that read the next slot as EMPTY before we held it can still CAS it after we
+ * released it (ABA), leaving a hole in its probe sequence; validateInsert catches that.
+ *
+ * @return number of tombstones turned into EMPTY (0 if the one at index stays)
+ */
+template <typename K>
+int AlgorithmD<K>::purgeTombstones(table * t, int index) {
+    int purged = 0;
+    while (purged < t->capacity - 1) {
+        int next = (index + 1) % t->capacity;
+        K expected = EMPTY;
+        if (!t->data[next].v.compare_exchange_strong(expected, PURGING))
+            break;
+        expected = TOMBSTONE;
+        bool cleared = t->data[index].v.compare_exchange_strong(expected, EMPTY);  // fails if a migration froze it
+        expected = PURGING;
+        t->data[next].v.compare_exchange_strong(expected, EMPTY);                  // fails if a migration froze it
+        if (!cleared)
+            break;
+        purged++;
+        index = (index + t->capacity - 1) % t->capacity;
+        if (t->data[index].v.load() != TOMBSTONE)
+            break;
+    }
+    return purged;
+}
+
+/**
+ * Called after an insert placed key at probe position i > 0 (slot probeIndex(h, i, capacity)) with purging on.
+ * A purge can only open a hole in the probe sequence right behind the first EMPTY slot, which
+ * is where we placed the key, so we walk the sequence backward: once a slot is seen non-EMPTY
+ * it stays so, because the slot after it is. If we find a hole (the key may be unreachable) or
+ * another copy of the key, we take ours back with a tombstone and retry or report a duplicate.
+ */
+template <typename K>
+bool AlgorithmD<K>::validateInsert(const int tid, table * t, const K & key, uint32_t h, int i) {
+    int index = probeIndex(h, i, t->capacity);
+    bool hole = false, duplicate = false;
+    for (int j = i - 1; j >= 0; j--) {
+        K found = t->data[probeIndex(h, j, t->capacity)].v.load();
+        if (found == PURGING || (found & ~MARKED_MASK) == EMPTY)
+            hole = true;
+        else if ((found & ~MARKED_MASK) == key)
+            duplicate = true;
+    }
+    if (!hole && !duplicate)
+        return true;
+
+    K expected = key;
+    if (t->data[index].v.compare_exchange_strong(expected, TOMBSTONE)) {
+        t->tombStoneSize->inc(tid);
+        return hole ? insertIfAbsent(tid, key) : false;
+    }
+    if (expected != (key | MARKED_MASK))
+        return true;    // someone already erased our key, so it took effect
+
+    // A migration froze our copy and will move it. Once every slot of t is frozen, the
+    // copy furthest back in the probe sequence is the one that counts (its owner sees no
+    // duplicate before it); migrating the other one fails harmlessly.
+    table * next = currentTable.load();
+    if (next->prev == t)
+        helpExpansion(tid, next);
+    for (int j = 0; j < i; j++) {
+        if (t->data[probeIndex(h, j, t->capacity)].v.load() == (key | MARKED_MASK))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Group probing: returns the first probe offset in [i, capacity) whose slot may hold the key with
+ * hash h and tag tag, or capacity if there is none. Skipped slots have a different non-zero tag.
+ *
+ * Tags are written once, after the CAS that put a key in the slot, and never change afterwards:
+ * without purging a slot holds at most one key in a table's lifetime, and neither its tombstone nor
+ * a migration's mark changes which key that was. So a non-zero tag is never stale, and a slot that
+ * is EMPTY, or whose key is not tagged yet, reads as 0 and is checked like any other.
+ * (Tags are read with plain vector loads while other threads store single bytes; the keys in the
+ * data array stay authoritative, a tag only rules a slot out.)
+ */
+template <typename K>
+int AlgorithmD<K>::nextCandidate(const uint8_t * ctrl, int capacity, uint32_t h, int i, uint8_t tag) {
+    while (i < capacity) {
+        int index = probeIndex(h, i, capacity);
+        int run = std::min(probeRunLength(h, i, index, capacity), GROUP_WIDTH);
+        uint32_t candidates = groupCandidates(ctrl + index, tag);
+        if (run < 32)
+            candidates &= (1u << run) - 1;
+        if (candidates)
+            return i + __builtin_ctz(candidates);
+        i += run;
+    }
+    return capacity;
+}
+
+// read-only probe of one data array; a marked (frozen) cell still holds its key
+// returns the index of the slot holding key, or -1
+template <typename K>
+int AlgorithmD<K>::find(PaddedKeyAtomic<K> * data, uint8_t * ctrl, int capacity, const K & key) {
+    uint32_t h = traits::hash(key);
+    uint8_t tag = groupTag(h);
+    if (GROUP_PROBING)
+        __builtin_prefetch(&data[probeIndex(h, 0, capacity)]);    // overlap the miss on the keys with the one on the tags
+
+    for (int i = 0; i < capacity; i++) {
+        if (GROUP_PROBING && (i = nextCandidate(ctrl, capacity, h, i, tag)) == capacity)
+            break;
+        int index = probeIndex(h, i, capacity);
+        K found = data[index].v.load(std::memory_order_acquire) & ~MARKED_MASK;
+
+        if (found == key)
+            return index;
+        else if (found == EMPTY)
+            return -1;
+    }
+    return -1;
+}
+
+// semantics: return true if key is in the set, and false otherwise.
+// Takes no locks and does no CAS: it never helps with an expansion. While a
+// migration is running, keys that were not copied yet are read from the old table
+// (once a key's copy is done, only t->data counts, since it may have been erased there).
+template <typename K>
+bool AlgorithmD<K>::contains(const int tid, const K & key) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table* t = currentTable;
+
+    if (t->slotsLeft.load() > 0) {
+        int index = find(t->old, t->oldCtrl, t->oldCapacity, key);
+        if (index >= 0 && !t->slotDone[index].load(std::memory_order_acquire))
+            return true;
+    }
+    return find(t->data, t->ctrl, t->capacity, key) >= 0;
+}
+
+// address of key's home slot in the current table (what the batched operations prefetch)
+// (the caller must be inside an operation, so the current table cannot be freed under us)
+template <typename K>
+const void * AlgorithmD<K>::homeSlot(const K & key) {
+    table * t = currentTable.load(std::memory_order_relaxed);
+    return &t->data[probeIndex(traits::hash(key), 0, t->capacity)];
+}
+
+/**
+ * Bulk load: fills an EMPTY set with keys[0..n) (duplicates are inserted once) much faster than n inserts.
+ * The table is sized once, from n (the capacity a migration would give n live keys), and built by OpenMP
+ * threads before anyone can see it, so it takes no CAS, counter updates or resizes:
+ *
+ * 1. the keys are bucketed (counting sort) by which of numParts contiguous slot ranges their home slot is in;
+ * 2. each range is filled by one thread with plain stores, following the usual probe sequence; a key whose
+ *    probe would leave its range is set aside;
+ * 3. the keys set aside are inserted by the calling thread, with full probe sequences;
+ *
+ * and then the table is published with a single release store.
+ *
+ * The set must be empty, and no other thread may use it until bulkLoad returns (it is meant for startup).
+ * @return number of keys inserted
+ */
+template <typename K>
+int64_t AlgorithmD<K>::bulkLoad(const int tid, const K * keys, int64_t n) {
+    table * old = currentTable.load();
+    assert(old->slotsLeft.load() == 0 && old->approxSize->getAccurate() == 0);
+
+    int64_t wanted = std::max<int64_t>(initCapacity, std::min<int64_t>(n * EXPANSION_RATE, 1 << 30));
+    table * t = new table(roundCapacity((int) wanted), nullptr);
+    int capacity = t->capacity;
+    auto data = t->data;
+    auto ctrl = t->ctrl;
+
+    int numWorkers = omp_get_max_threads();
+    int numParts = (int) std::max<int64_t>(1, std::min<int64_t>(numWorkers * 16, capacity / 1024));
+    auto partOf = [&](const K & key) { return (int) ((int64_t) probeIndex(traits::hash(key), 0, capacity) * numParts / capacity); };
+
+    // 1. counting sort by part: every worker counts its share of keys, then scatters it to its own offsets
+    std::vector<int64_t> offsets((size_t) numWorkers * numParts, 0);
+    std::vector<int64_t> partStart(numParts + 1, 0);
+    std::vector<K> sorted(n);
+    std::vector<std::vector<K>> setAside(numParts);
+    int64_t inserted = 0;
+    #pragma omp parallel num_threads(numWorkers) reduction(+:inserted)
+    {
+        int64_t * mine = &offsets[(size_t) omp_get_thread_num() * numParts];
+        #pragma omp for schedule(static)
+        for (int64_t j = 0; j < n; j++) {
+            mine[partOf(keys[j])]++;
+        }
+        #pragma omp single
+        {
+            int64_t running = 0;
+            for (int p = 0; p < numParts; p++) {
+                partStart[p] = running;
+                for (int w = 0; w < numWorkers; w++) {
+                    int64_t count = offsets[(size_t) w * numParts + p];
+                    offsets[(size_t) w * numParts + p] = running;
+                    running += count;
+                }
+            }
+            partStart[numParts] = running;
+        }
+        // (same static schedule as the counting loop, so every worker sees the same keys again)
+        #pragma omp for schedule(static)
+        for (int64_t j = 0; j < n; j++) {
+            sorted[mine[partOf(keys[j])]++] = keys[j];
+        }
+
+        // 2. fill every part with plain stores (the table is not published yet)
+        #pragma omp for schedule(dynamic)
+        for (int p = 0; p < numParts; p++) {
+            int lo = (int) ((int64_t) p * capacity / numParts);
+            int hi = (int) ((int64_t) (p + 1) * capacity / numParts);
+            for (int64_t j = partStart[p]; j < partStart[p + 1]; j++) {
+                K key = sorted[j];
+                uint32_t h = traits::hash(key);
+                for (int i = 0; ; i++) {
+                    int index = probeIndex(h, i, capacity);
+                    if (index < lo || index >= hi) {
+                        setAside[p].push_back(key);
+                        break;
+                    }
+                    K found = data[index].v.load(std::memory_order_relaxed);
+                    if (found == key)
+                        break;
+                    if (found == EMPTY) {
+                        data[index].v.store(key, std::memory_order_relaxed);
+                        if (GROUP_PROBING)
+                            ctrl[index] = groupTag(h);
+                        inserted++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // 3. the keys whose probe sequences cross a part boundary
+    for (int p = 0; p < numParts; p++) {
+        for (K key : setAside[p]) {
+            uint32_t h = traits::hash(key);
+            for (int i = 0; i < capacity; i++) {
+                int index = probeIndex(h, i, capacity);
+                K found = data[index].v.load(std::memory_order_relaxed);
+                if (found == key)
+                    break;
+                if (found == EMPTY) {
+                    data[index].v.store(key, std::memory_order_relaxed);
+                    if (GROUP_PROBING)
+                        ctrl[index] = groupTag(h);
+                    inserted++;
+                    break;
+                }
+            }
+        }
+    }
+
+    t->approxSize = new counter(numThreads, expansionHeadroom(t));
+    t->tombStoneSize = new counter(numThreads, expansionHeadroom(t));
+    t->approxSize->add(tid, inserted);
+    currentTable.store(t, std::memory_order_release);
+    reclaimer.retire(tid, old);
+    return inserted;
+}
+
+// semantics: results[j] = insertIfAbsent(tid, keys[j]) for every j < n, in order; returns how many are true.
+// The whole batch runs inside one epoch, so a table retired halfway through stays readable for the
+// prefetches (the keys themselves always go through the full insertIfAbsent, resizes included).
+template <typename K>
+int AlgorithmD<K>::insertBatch(const int tid, const K * keys, int n, bool * results) {
+    EpochGuard<table> guard(reclaimer, tid);
+    return runBatch<true>(n, results, [&](int j) { return homeSlot(keys[j]); },
+                                      [&](int j) { return insertIfAbsent(tid, keys[j]); });
+}
+
+// semantics: results[j] = erase(tid, keys[j]) for every j < n, in order; returns how many are true
+template <typename K>
+int AlgorithmD<K>::eraseBatch(const int tid, const K * keys, int n, bool * results) {
+    EpochGuard<table> guard(reclaimer, tid);
+    return runBatch<true>(n, results, [&](int j) { return homeSlot(keys[j]); },
+                                      [&](int j) { return erase(tid, keys[j]); });
+}
+
+// semantics: results[j] = contains(tid, keys[j]) for every j < n; returns how many are true
+template <typename K>
+int AlgorithmD<K>::containsBatch(const int tid, const K * keys, int n, bool * results) {
+    EpochGuard<table> guard(reclaimer, tid);
+    return runBatch<false>(n, results, [&](int j) { return homeSlot(keys[j]); },
+                                       [&](int j) { return contains(tid, keys[j]); });
+}
+
 // semantics: return the sum of all KEYS in the set
-int64_t AlgorithmD::getSumOfKeys() {
+template <typename K>
+int64_t AlgorithmD<K>::getSumOfKeys() {
 
     table* t = currentTable.load();  // Get the current table
-    int64_t sum = 0;
-
-    for (int i = 0; i < t->capacity; i++) {
-        int key = t->data[i].v.load(std::memory_order_relaxed);  // Read value
-        if (key != EMPTY && key != TOMBSTONE)   // Only sum up valid keys
-            sum += key;
+    // (parallel, vectorized: see parallelSum and sumLiveKeys in util.h)
+    int64_t sum = parallelSum(t->capacity, [&](int64_t begin, int64_t end) {
+        return sumLiveKeys((const K *) t->data, begin, end, EMPTY, TOMBSTONE);
+    });
+
+    // An unfinished migration (incremental mode) leaves keys in the old table; with no operation
+    // running, every frozen one has been copied already, so only the unfrozen ones are missing
+    if (t->slotsLeft.load() > 0) {
+        sum += parallelSum(t->oldCapacity, [&](int64_t begin, int64_t end) {
+            auto old = t->old;  // (the atomic loads would make the compiler reload t->old on every slot)
+            int64_t chunkSum = 0;
+            for (int64_t i = begin; i < end; i++) {
+                K key = old[i].v.load(std::memory_order_relaxed);
+                if (key != EMPTY && key != TOMBSTONE && !(key & MARKED_MASK))
+                    chunkSum += key;
+            }
+            return chunkSum;
+        });
     }
     
     return sum;
 }
 
-// print any debugging details you want at the end of a trial in this function
-void AlgorithmD::printDebuggingDetails() {
+/**
+ * Calls visit(key) for the keys in the set, from several threads at once (see parallelFor in util.h);
+ * may run concurrently with other operations. Every key that is in the set for the whole scan is visited
+ * exactly once; keys inserted or erased during the scan may or may not be.
+ *
+ * A migration that is running when the scan starts is finished first (completeMigration), so that every
+ * key is in one table. Keys that a migration starting during the scan freezes stay readable where they
+ * are, so the scan still finds them there.
+ */
+template <typename K>
+template <typename Visit>
+void AlgorithmD<K>::forEachKey(const int tid, Visit visit) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table * t = currentTable.load();
+    completeMigration(tid, t);
+    parallelFor(t->capacity, [&](int64_t begin, int64_t end) {
+        auto data = t->data;
+        for (int64_t i = begin; i < end; i++) {
+            K key = data[i].v.load(std::memory_order_relaxed) & ~MARKED_MASK;
+            if (key != EMPTY && key != TOMBSTONE)
+                visit(key);
+        }
+    });
+}
+
+// semantics: the sum of all keys in the set, safe to call while other threads operate on it (same guarantee as forEachKey)
+template <typename K>
+int64_t AlgorithmD<K>::sumKeys(const int tid) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table * t = currentTable.load();
+    completeMigration(tid, t);
+    return parallelSum(t->capacity, [&](int64_t begin, int64_t end) {
+        return sumLiveKeys((const K *) t->data, begin, end, EMPTY, TOMBSTONE, MARKED_MASK);
+    });
+}
 
+// semantics: changes whenever a migration starts or completes, and is odd while one is running
+// (lets the benchmark tell operations that overlapped a resize from the others)
+template <typename K>
+int64_t AlgorithmD<K>::getResizeStamp(const int tid) {
+    EpochGuard<table> guard(reclaimer, tid);
+    int64_t started = migrationCount.load();
+    return 2 * started + (currentTable.load()->slotsLeft.load() > 0 ? 1 : 0);
+}
+
+// print any debugging details you want at the end of a trial in this function
+template <typename K>
+void AlgorithmD<K>::printDebuggingDetails() {
+    cout<<"migrations: "<<migrationCount<<" (same-size tombstone cleanups: "<<cleanupCount - snapshotCount<<", shrinks: "<<shrinkCount<<", snapshots: "<<snapshotCount<<")"<<endl;
+    cout<<"current capacity: "<<currentTable.load()->capacity<<endl;
+    cout<<"table memory: "<<tableMemoryName()<<" (hugetlb fallbacks: "<<tableMemory.hugetlbFallbacks<<", interleave failures: "<<tableMemory.interleaveFailures<<")"<<endl;
+    cout<<"size counters' error bound: "<<currentTable.load()->approxSize->errorBound() + currentTable.load()->tombStoneSize->errorBound()<<endl;
+    cout<<"tombstones purged in place: "<<purgedTombstones.getTotal()<<endl;
+    cout<<"copies finished for the thread that froze the key: "<<copyHelps.getTotal()<<endl;
+    int64_t keysCopied = chunkKeysCopied.getTotal();
+    cout<<"keys migrated by chunk: "<<keysCopied<<" ("<<(keysCopied ? chunkNanos.getTotal() / 1000000.0 / (keysCopied / 1000000.0) : 0)<<" ms per million keys)"<<endl;
+    cout<<"new tables built: "<<tableSetups.getTotal()<<" (setup microseconds: total "<<tableSetupMicros.getTotal()<<", max "<<maxTableSetupMicros<<")"<<endl;
+    cout<<"retired tables not yet freed: "<<reclaimer.getPendingCount()<<endl;
 }
 
 
-void AlgorithmD::printTable(PaddedInt64Atomic* data, int capacity){
+template <typename K>
+void AlgorithmD<K>::printTable(PaddedKeyAtomic<K>* data, int capacity){
     for (int i = 0; i < capacity; i++){
-        int dataPoint = data[i].v.load();
+        K dataPoint = data[i].v.load();
         if(dataPoint & MARKED_MASK)
             printf("# | ");
         else if (dataPoint == TOMBSTONE)
@@ -415,7 +1538,7 @@ void AlgorithmD::printTable(PaddedInt64Atomic* data, int capacity){
         else if (dataPoint == EMPTY)
             printf("E | ");
         else
-            printf("%d | ", dataPoint);
+            cout<<dataPoint<<" | ";
         // printf("%d-", data[i].v.load());
         if(i % 20 == 0)
             printf("\n");
@@ -0,0 +1,373 @@
+#pragma once
+#include "util.h"
+#include "reclaimer.h"
+#include "alg_d.h"      // shares EXPANSION_RATE, TABLE_PARTITION_SIZE and EXPANSION_CAPACITY_TRIGGER with the set
+#include <atomic>
+#include <cassert>
+using namespace std;
+
+/*
+./benchmark.out -a DM -sT 10000 -m 10000 -sR 1000000 -t 16 -pL 90
+*/
+
+struct KeyValueAtomic {
+    // key in the high 32 bits, value in the low 32 bits, so a pair is always updated with one CAS
+    std::atomic<uint64_t> v;
+};
+
+/**
+ * Key-value variant of AlgorithmD: the same expandable, cooperatively migrated
+ * linear-probing table, but every slot holds a 32-bit key together with its
+ * 32-bit value. Keys use the same reserved encodings as AlgorithmD (the mark
+ * bit is the key's most significant bit), so valid keys are [1, 0x7FFFFFFE];
+ * values are arbitrary.
+ */
+class AlgorithmDMap {
+private:
+    static constexpr uint64_t MARKED_MASK = 0x8000000000000000ULL;     // most significant bit of the key half
+    static constexpr uint64_t TOMBSTONE   = 0x7FFFFFFF00000000ULL;     // key 0x7FFFFFFF, any value ignored
+    static constexpr uint64_t EMPTY       = 0;
+
+    static inline uint64_t pack(const int key, const int value) {
+        return ((uint64_t) (uint32_t) key << 32) | (uint32_t) value;
+    }
+    static inline int keyOf(const uint64_t slot) {
+        return (int) (uint32_t) (slot >> 32);
+    }
+    static inline int valueOf(const uint64_t slot) {
+        return (int) (uint32_t) slot;
+    }
+    static inline bool isEmpty(const uint64_t slot) {
+        return (slot & ~MARKED_MASK) >> 32 == 0;
+    }
+    static inline bool isTombstone(const uint64_t slot) {
+        return (slot & 0xFFFFFFFF00000000ULL) == TOMBSTONE;
+    }
+
+    char padding2[PADDING_BYTES];
+    int numThreads;
+    int initCapacity;
+    char padding3[PADDING_BYTES];
+
+    struct table {
+        alignas(PADDING_BYTES) KeyValueAtomic *data;            // Pointer to data array
+
+        alignas(PADDING_BYTES) KeyValueAtomic *old;             // Pointer to old table (during expansion)
+
+        alignas(PADDING_BYTES) int capacity;                   // Current table capacity
+        char padding2[PADDING_BYTES - sizeof(int)];
+
+        alignas(PADDING_BYTES) int oldCapacity;                // Old table capacity (before expansion)
+        char padding3[PADDING_BYTES - sizeof(int)];
+
+        alignas(PADDING_BYTES) counter *approxSize;            // Approximate size counter
+        char padding4[PADDING_BYTES - sizeof(counter*)];
+
+        alignas(PADDING_BYTES) counter *tombStoneSize;         // Approximate tombstone counter
+        char padding7[PADDING_BYTES - sizeof(counter*)];
+
+        alignas(PADDING_BYTES) chunkClaimer * chunks;          // Hands out the old table's chunks to the helpers (nullptr: no migration)
+        char padding5[PADDING_BYTES - sizeof(chunkClaimer*)];
+
+        alignas(PADDING_BYTES) std::atomic<int> chunksDone;    // Number of completed migrations
+        char padding6[PADDING_BYTES - sizeof(std::atomic<int>)];
+
+        alignas(PADDING_BYTES) int chunkSize;                  // Old slots per chunk (migrationChunkSlots), fixed at creation so all helpers agree
+        int totalOldChunks;
+        table * prev;                                          // Table we migrate from (retired once the migration is done)
+        char padding8[PADDING_BYTES - 2 * sizeof(int) - sizeof(table*)];
+
+        // Constructor
+        table(int init_capacity)
+        : data(new KeyValueAtomic[init_capacity]),
+          old(nullptr),
+          capacity(init_capacity),
+          oldCapacity(0),
+          chunks(nullptr),
+          chunksDone(0),
+          chunkSize(TABLE_PARTITION_SIZE),
+          totalOldChunks(0),
+          prev(nullptr)
+        {
+            for (int i = 0; i < capacity; i++) {
+                data[i].v.store(EMPTY, std::memory_order_relaxed);
+            }
+        }
+
+        // Expansion constructor
+        table(const table& oldTable, int numThreads)
+        {
+            oldCapacity = oldTable.capacity;
+            // Sized from the accurate counts (the approximate ones can be off by their error bound), and never
+            // below the old capacity: every key of the old table then has a slot here, whatever the counts say,
+            // and nothing else is written here until the migration is done (see helpExpansion).
+            int64_t liveKeys = oldTable.approxSize->getAccurate() - oldTable.tombStoneSize->getAccurate();
+            capacity = roundCapacity((int) std::max<int64_t>(liveKeys * EXPANSION_RATE, oldCapacity));
+            data = new KeyValueAtomic[capacity];
+            old = oldTable.data;
+            chunksDone = 0;
+            chunkSize = migrationChunkSlots(oldCapacity, numThreads, sizeof(KeyValueAtomic));
+            totalOldChunks = (oldCapacity + chunkSize - 1) / chunkSize;
+            chunks = new chunkClaimer(totalOldChunks, numThreads);
+            prev = const_cast<table*>(&oldTable);
+
+            for (int i = 0; i < capacity; i++) {
+                data[i].v.store(EMPTY, std::memory_order_relaxed);
+            }
+        }
+
+        // Destructor
+        ~table() {
+            delete[] data;
+            delete chunks;
+            delete approxSize;
+            delete tombStoneSize;
+        }
+    };
+
+    char padding0[64];
+    atomic<table *> currentTable;
+    char padding1[64];
+
+    EpochReclaimer<table> reclaimer;                           // Frees tables once no thread can still be reading them
+
+    bool expandAsNeeded(const int tid, table * t, int i);
+    void helpExpansion(const int tid, table * t);
+    void startExpansion(const int tid, table * t);
+    void migrate(const int tid, table * t, int myChunk);
+    bool put(const int tid, const int & key, const int & value, bool overwrite, bool ExpansionMode);
+    bool find(KeyValueAtomic * data, int capacity, const int & key, int & value);
+
+public:
+    AlgorithmDMap(const int _numThreads, const int _capacity);
+    ~AlgorithmDMap();
+    bool insert(const int tid, const int & key, const int & value);
+    bool upsert(const int tid, const int & key, const int & value);
+    bool get(const int tid, const int & key, int & value);
+    bool erase(const int tid, const int & key);
+    long getSumOfKeys();
+    void printDebuggingDetails();
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
+ */
+AlgorithmDMap::AlgorithmDMap(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), initCapacity(roundCapacity(_capacity)), reclaimer(_numThreads) {
+    table* initialTable = new table(initCapacity);
+    // (counters of a small table flush often enough for it to notice when it has to expand)
+    initialTable->approxSize = new counter(numThreads, (int64_t) (initCapacity * EXPANSION_CAPACITY_TRIGGER) / 2);
+    initialTable->tombStoneSize = new counter(numThreads, (int64_t) (initCapacity * EXPANSION_CAPACITY_TRIGGER) / 2);
+    currentTable.store(initialTable);
+}
+
+// destructor: clean up any allocated memory, etc.
+// (no thread may be inside an operation; tables retired earlier are freed by the reclaimer)
+AlgorithmDMap::~AlgorithmDMap() {
+    delete currentTable.load();
+}
+
+bool AlgorithmDMap::expandAsNeeded(const int tid, table * t, int i) {
+    helpExpansion(tid, t);
+
+    if (t->approxSize->get() + t->tombStoneSize->get() >= t->capacity * EXPANSION_CAPACITY_TRIGGER) {
+        startExpansion(tid, t);
+        return true;
+    }
+    return false;
+}
+
+void AlgorithmDMap::helpExpansion(const int tid, table * t) {
+    int totalOldChunks = t->totalOldChunks;
+
+    if (!t->chunks)
+        return;     // (the first table never migrates)
+    int myChunk;
+    while ((myChunk = t->chunks->claim(tid)) >= 0) {
+        migrate(tid, t, myChunk);
+        if (t->chunksDone.fetch_add(1) + 1 == totalOldChunks) {
+            // Last chunk moved: nobody will read the old table through t again
+            reclaimer.retire(tid, t->prev);
+        }
+    }
+    while (t->chunksDone < totalOldChunks) {}
+}
+
+void AlgorithmDMap::startExpansion(const int tid, table * t) {
+    if (currentTable == t) {
+        table* t_new = new table(*t, numThreads);
+        t_new->approxSize = new counter(numThreads, (int64_t) (t_new->capacity * EXPANSION_CAPACITY_TRIGGER) / 2);
+        t_new->tombStoneSize = new counter(numThreads, (int64_t) (t_new->capacity * EXPANSION_CAPACITY_TRIGGER) / 2);
+
+        if (!currentTable.compare_exchange_strong(t, t_new)) {
+            delete t_new;   // never published, so it can be freed right away
+        }
+    }
+    helpExpansion(tid, currentTable);
+}
+
+void AlgorithmDMap::migrate(const int tid, table * t, int myChunk) {
+    int start = myChunk * t->chunkSize;
+    int end = min(start + t->chunkSize, t->oldCapacity);
+
+    for (int i = start; i < end; i++) {
+        uint64_t slot = t->old[i].v.load();
+
+        if (isTombstone(slot))
+            continue;
+
+        // Freeze the whole pair: a concurrent upsert of this key now fails its CAS and retries in the new table
+        if (!(t->old[i].v.compare_exchange_strong(slot, slot | MARKED_MASK))) {
+            i--;
+            continue;
+        }
+
+        if (!isEmpty(slot)) {
+            // Insert into the new table (disable expansion), carrying the value along
+            if (!put(tid, keyOf(slot), valueOf(slot), false, true)) {
+                fprintf(stderr, "ERROR: could not copy key %d of the old table into the new one (capacity %d)\n", keyOf(slot), t->capacity);
+                abort();
+            }
+        }
+    }
+}
+
+// shared body of insert/upsert (and of migration, with ExpansionMode); returns true iff the key was not present
+bool AlgorithmDMap::put(const int tid, const int & key, const int & value, bool overwrite, bool ExpansionMode) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table* t = currentTable;
+    uint32_t h = murmur3(key);
+    uint64_t desired = pack(key, value);
+
+    for (int i = 0; i < t->capacity; i++) {
+        if (!ExpansionMode && expandAsNeeded(tid, t, i))
+            return put(tid, key, value, overwrite, false);
+
+        int index = probeIndex(h, i, t->capacity);
+        uint64_t found = t->data[index].v.load();
+
+        if (!ExpansionMode && (found & MARKED_MASK)) {
+            return put(tid, key, value, overwrite, false);
+        }
+        else if (keyOf(found) == key) {
+            if (!overwrite)
+                return false;
+            // Replace the value; on failure found holds the slot's current contents
+            while (!t->data[index].v.compare_exchange_strong(found, desired)) {
+                if (found & MARKED_MASK)
+                    return put(tid, key, value, overwrite, false);
+                if (keyOf(found) != key)
+                    break;      // erased meanwhile: keep probing, the key is absent now
+            }
+            if (keyOf(found) == key)
+                return false;
+        }
+        else if (found == EMPTY) {
+            uint64_t expected = EMPTY;
+            if (t->data[index].v.compare_exchange_strong(expected, desired)) {
+                t->approxSize->inc(tid);
+                return true;
+            }
+            i--;    // lost the race for this slot: look at what was written there
+        }
+    }
+    return false;
+}
+
+// semantics: insert key with value if key is absent. return true if successful, and false otherwise (value is left unchanged)
+bool AlgorithmDMap::insert(const int tid, const int & key, const int & value) {
+    return put(tid, key, value, false, false);
+}
+
+// semantics: insert key with value, or replace the value if key is present. return true iff key was absent
+bool AlgorithmDMap::upsert(const int tid, const int & key, const int & value) {
+    return put(tid, key, value, true, false);
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+bool AlgorithmDMap::erase(const int tid, const int & key) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table* t = currentTable.load();
+    uint32_t h = murmur3(key);
+
+    for (int i = 0; i < t->capacity; i++) {
+        if (expandAsNeeded(tid, t, i))
+            return erase(tid, key);
+
+        int index = probeIndex(h, i, t->capacity);
+        uint64_t found = t->data[index].v;
+
+        if (found & MARKED_MASK)
+            return erase(tid, key);
+
+        if (found == EMPTY)
+            return false;
+
+        if (keyOf(found) == key) {
+            // the value may change under us, so retry until the key itself is gone
+            while (!t->data[index].v.compare_exchange_strong(found, TOMBSTONE)) {
+                if (found & MARKED_MASK)
+                    return erase(tid, key);
+                if (keyOf(found) != key)
+                    return false;
+            }
+            t->tombStoneSize->inc(tid);
+            return true;
+        }
+    }
+    return false;
+}
+
+// read-only probe of one data array; a marked (frozen) pair still holds its key and value
+bool AlgorithmDMap::find(KeyValueAtomic * data, int capacity, const int & key, int & value) {
+    uint32_t h = murmur3(key);
+
+    for (int i = 0; i < capacity; i++) {
+        int index = probeIndex(h, i, capacity);
+        uint64_t found = data[index].v.load(std::memory_order_acquire) & ~MARKED_MASK;
+
+        if (keyOf(found) == key) {
+            value = valueOf(found);
+            return true;
+        }
+        else if (found >> 32 == 0)
+            return false;
+    }
+    return false;
+}
+
+// semantics: if key is present, store its value in value and return true; otherwise return false.
+// Like AlgorithmD::contains, it takes no locks, does no CAS and reads through to the old table during a migration.
+bool AlgorithmDMap::get(const int tid, const int & key, int & value) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table* t = currentTable;
+
+    if (t->chunksDone.load() < t->totalOldChunks && find(t->old, t->oldCapacity, key, value))
+        return true;
+    return find(t->data, t->capacity, key, value);
+}
+
+// semantics: return the sum of all KEYS in the map
+int64_t AlgorithmDMap::getSumOfKeys() {
+    table* t = currentTable.load();
+
+    // (chunks in parallel, see parallelSum in util.h)
+    return parallelSum(t->capacity, [&](int64_t begin, int64_t end) {
+        auto data = t->data;    // (the atomic loads would make the compiler reload t->data on every slot)
+        int64_t sum = 0;
+        for (int64_t i = begin; i < end; i++) {
+            uint64_t slot = data[i].v.load(std::memory_order_relaxed);
+            if (!isEmpty(slot) && !isTombstone(slot))
+                sum += keyOf(slot);
+        }
+        return sum;
+    });
+}
+
+// print any debugging details you want at the end of a trial in this function
+void AlgorithmDMap::printDebuggingDetails() {
+    cout<<"retired tables not yet freed: "<<reclaimer.getPendingCount()<<endl;
+}
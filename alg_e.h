@@ -0,0 +1,274 @@
+#pragma once
+#include "util.h"
+#include <atomic>
+using namespace std;
+
+// A key never sits more than this many slots past its home slot; the table has that many extra
+// slots at the end instead of wrapping around, so every probe moves forward only.
+#define ROBIN_HOOD_MAX_DISPLACEMENT 128
+// Writers lock groups of this many consecutive slots
+#define ROBIN_HOOD_STRIPE_SLOTS 64
+// Stripes a probe can cover (a displacement of MAX_DISPLACEMENT starting anywhere in a stripe)
+#define ROBIN_HOOD_MAX_PROBE_STRIPES (ROBIN_HOOD_MAX_DISPLACEMENT / ROBIN_HOOD_STRIPE_SLOTS + 2)
+
+/**
+ * Robin Hood hash table (static capacity, like A-C). Every cluster keeps its keys ordered by home
+ * slot, so a probe can stop at the first slot whose key is closer to its home than the probe is to
+ * its own ("early termination"), and an erase shifts the rest of the cluster back by one slot instead
+ * of leaving a tombstone ("backward-shift deletion"). This keeps probes short at loads above 0.9.
+ *
+ * A slot holds key | displacement << 32 (0: EMPTY), so no probe rehashes the keys it passes.
+ *
+ * Concurrency: an insert or erase moves keys, but only at or after its own key's home slot. It locks
+ * the stripes it reads, in ascending order (no wrap-around, so no deadlock), and holds them until it is
+ * done. Every stripe's lock is also a seqlock version (odd while locked): contains takes no locks, and
+ * retries if a stripe it read from changed while it was reading.
+ */
+class AlgorithmE {
+public:
+    static constexpr uint64_t EMPTY = 0;
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    int capacity;                                   // home slots; the array has ROBIN_HOOD_MAX_DISPLACEMENT more, plus one that stays EMPTY
+    int numStripes;
+    char padding2[PADDING_BYTES];
+
+    std::atomic<uint64_t> * slots;
+    char padding3[PADDING_BYTES];
+    std::atomic<uint64_t> * versions;               // per stripe: even = unlocked, odd = a writer holds it
+    char padding4[PADDING_BYTES];
+    debugCounter refusedInserts;                    // inserts of absent keys that would exceed the displacement bound
+
+    AlgorithmE(const int _numThreads, const int _capacity);
+    ~AlgorithmE();
+    bool insertIfAbsent(const int tid, const int & key);
+    bool erase(const int tid, const int & key);
+    bool contains(const int tid, const int & key);
+    int insertBatch(const int tid, const int * keys, int n, bool * results);
+    int eraseBatch(const int tid, const int * keys, int n, bool * results);
+    int containsBatch(const int tid, const int * keys, int n, bool * results);
+    long getSumOfKeys();
+    void printDebuggingDetails();
+
+private:
+    static uint64_t makeSlot(int key, int displacement) { return (uint32_t) key | (uint64_t) displacement << 32; }
+    static int keyOf(uint64_t slot) { return (int) (uint32_t) slot; }
+    static int displacementOf(uint64_t slot) { return (int) (slot >> 32); }
+    static int stripeOf(int index) { return index / ROBIN_HOOD_STRIPE_SLOTS; }
+
+    void lockStripe(int stripe);
+    void unlockStripes(int first, int last);
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
+ */
+AlgorithmE::AlgorithmE(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), capacity(roundCapacity(_capacity)) {
+    int totalSlots = capacity + ROBIN_HOOD_MAX_DISPLACEMENT + 1;
+    numStripes = stripeOf(totalSlots - 1) + 1;
+    slots = new std::atomic<uint64_t>[totalSlots];
+    versions = new std::atomic<uint64_t>[numStripes];
+    for (int i = 0; i < totalSlots; i++) {
+        slots[i].store(EMPTY, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < numStripes; i++) {
+        versions[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// destructor: clean up any allocated memory, etc.
+AlgorithmE::~AlgorithmE() {
+    delete[] slots;
+    delete[] versions;
+}
+
+void AlgorithmE::lockStripe(int stripe) {
+    while (true) {
+        uint64_t v = versions[stripe].load(std::memory_order_relaxed);
+        if (!(v & 1) && versions[stripe].compare_exchange_weak(v, v + 1, std::memory_order_acquire))
+            break;
+    }
+    // readers that see any of our slot writes must also see the odd version
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void AlgorithmE::unlockStripes(int first, int last) {
+    for (int s = first; s <= last; s++) {
+        versions[s].fetch_add(1, std::memory_order_release);
+    }
+}
+
+// semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
+// (also false, counted in refusedInserts, if placing key would push some key past ROBIN_HOOD_MAX_DISPLACEMENT)
+bool AlgorithmE::insertIfAbsent(const int tid, const int & key) {
+    int home = probeIndex(murmur3(key), 0, capacity);
+    int firstStripe = stripeOf(home), lastStripe = firstStripe;
+    lockStripe(firstStripe);
+
+    // find where key belongs: the first slot that is EMPTY or holds a key closer to its home than we are
+    int pos = home;
+    for (int dist = 0; ; pos++, dist++) {
+        if (stripeOf(pos) > lastStripe) lockStripe(++lastStripe);
+        uint64_t slot = slots[pos].load(std::memory_order_relaxed);
+        if (slot == EMPTY || displacementOf(slot) < dist)
+            break;
+        if (keyOf(slot) == key) {
+            unlockStripes(firstStripe, lastStripe);
+            return false;
+        }
+    }
+    if (pos - home > ROBIN_HOOD_MAX_DISPLACEMENT) {
+        unlockStripes(firstStripe, lastStripe);
+        refusedInserts.inc(tid);
+        return false;
+    }
+
+    // the rest of the cluster moves one slot further from home; check that all of it still fits first
+    int end = pos;
+    while (true) {
+        if (stripeOf(end) > lastStripe) lockStripe(++lastStripe);
+        uint64_t slot = slots[end].load(std::memory_order_relaxed);
+        if (slot == EMPTY)
+            break;
+        if (displacementOf(slot) == ROBIN_HOOD_MAX_DISPLACEMENT) {
+            unlockStripes(firstStripe, lastStripe);
+            refusedInserts.inc(tid);
+            return false;
+        }
+        end++;
+    }
+    for (int i = end; i > pos; i--) {
+        uint64_t moved = slots[i - 1].load(std::memory_order_relaxed);
+        slots[i].store(makeSlot(keyOf(moved), displacementOf(moved) + 1), std::memory_order_relaxed);
+    }
+    slots[pos].store(makeSlot(key, pos - home), std::memory_order_relaxed);
+
+    unlockStripes(firstStripe, lastStripe);
+    return true;
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+bool AlgorithmE::erase(const int tid, const int & key) {
+    int home = probeIndex(murmur3(key), 0, capacity);
+    int firstStripe = stripeOf(home), lastStripe = firstStripe;
+    lockStripe(firstStripe);
+
+    int pos = home;
+    for (int dist = 0; ; pos++, dist++) {
+        if (stripeOf(pos) > lastStripe) lockStripe(++lastStripe);
+        uint64_t slot = slots[pos].load(std::memory_order_relaxed);
+        if (slot == EMPTY || displacementOf(slot) < dist) {
+            unlockStripes(firstStripe, lastStripe);
+            return false;
+        }
+        if (keyOf(slot) == key)
+            break;
+    }
+
+    // backward shift: pull every following key that is not at its home one slot closer to it
+    while (true) {
+        if (stripeOf(pos + 1) > lastStripe) lockStripe(++lastStripe);
+        uint64_t next = slots[pos + 1].load(std::memory_order_relaxed);
+        if (next == EMPTY || displacementOf(next) == 0)
+            break;
+        slots[pos].store(makeSlot(keyOf(next), displacementOf(next) - 1), std::memory_order_relaxed);
+        pos++;
+    }
+    slots[pos].store(EMPTY, std::memory_order_relaxed);
+
+    unlockStripes(firstStripe, lastStripe);
+    return true;
+}
+
+// semantics: return true if key is in the set, and false otherwise
+// (no locks: reads the stripes' versions before and after, and probes again if a writer got in between)
+bool AlgorithmE::contains(const int tid, const int & key) {
+    int home = probeIndex(murmur3(key), 0, capacity);
+    int firstStripe = stripeOf(home);
+    uint64_t seen[ROBIN_HOOD_MAX_PROBE_STRIPES];
+
+    while (true) {
+        int numSeen = 0;
+        bool found = false;
+        for (int pos = home, dist = 0; dist <= ROBIN_HOOD_MAX_DISPLACEMENT; pos++, dist++) {
+            if (stripeOf(pos) == firstStripe + numSeen) {
+                uint64_t v;
+                while ((v = versions[firstStripe + numSeen].load(std::memory_order_acquire)) & 1) {}
+                seen[numSeen++] = v;
+            }
+            uint64_t slot = slots[pos].load(std::memory_order_relaxed);
+            if (slot == EMPTY || displacementOf(slot) < dist)
+                break;
+            if (keyOf(slot) == key) {
+                found = true;
+                break;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool unchanged = true;
+        for (int s = 0; s < numSeen; s++) {
+            if (versions[firstStripe + s].load(std::memory_order_relaxed) != seen[s]) {
+                unchanged = false;
+                break;
+            }
+        }
+        if (unchanged)
+            return found;
+    }
+}
+
+// semantics: results[j] = insertIfAbsent(tid, keys[j]) for every j < n, in order; returns how many are true
+// (see runBatch: the home slots of upcoming keys are prefetched while earlier ones are inserted)
+int AlgorithmE::insertBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &slots[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return insertIfAbsent(tid, keys[j]); });
+}
+
+// semantics: results[j] = erase(tid, keys[j]) for every j < n, in order; returns how many are true
+int AlgorithmE::eraseBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<true>(n, results, [&](int j) { return &slots[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                      [&](int j) { return erase(tid, keys[j]); });
+}
+
+// semantics: results[j] = contains(tid, keys[j]) for every j < n; returns how many are true
+int AlgorithmE::containsBatch(const int tid, const int * keys, int n, bool * results) {
+    return runBatch<false>(n, results, [&](int j) { return &slots[probeIndex(murmur3(keys[j]), 0, capacity)]; },
+                                       [&](int j) { return contains(tid, keys[j]); });
+}
+
+// semantics: return the sum of all KEYS in the set
+int64_t AlgorithmE::getSumOfKeys() {
+    // (chunks in parallel, see parallelSum in util.h)
+    return parallelSum(capacity + ROBIN_HOOD_MAX_DISPLACEMENT, [&](int64_t begin, int64_t end) {
+        auto slots = this->slots;   // (the atomic loads would make the compiler reload this->slots on every slot)
+        int64_t sum = 0;
+        for (int64_t i = begin; i < end; i++) {
+            uint64_t slot = slots[i].load(std::memory_order_relaxed);
+            if (slot != EMPTY)
+                sum += keyOf(slot);
+        }
+        return sum;
+    });
+}
+
+// print any debugging details you want at the end of a trial in this function
+void AlgorithmE::printDebuggingDetails() {
+    int64_t keys = 0, totalDisplacement = 0;
+    int maxDisplacement = 0;
+    for (int i = 0; i < capacity + ROBIN_HOOD_MAX_DISPLACEMENT; i++) {
+        uint64_t slot = slots[i].load(std::memory_order_relaxed);
+        if (slot == EMPTY) continue;
+        keys++;
+        totalDisplacement += displacementOf(slot);
+        maxDisplacement = std::max(maxDisplacement, displacementOf(slot));
+    }
+    cout<<"load factor: "<<(double) keys / capacity<<endl;
+    cout<<"displacement: mean "<<(keys ? (double) totalDisplacement / keys : 0)<<", max "<<maxDisplacement<<" (bound "<<ROBIN_HOOD_MAX_DISPLACEMENT<<")"<<endl;
+    cout<<"inserts refused by the displacement bound: "<<refusedInserts.getTotal()<<endl;
+}
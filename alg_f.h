@@ -0,0 +1,508 @@
+#pragma once
+#include "util.h"
+#include "reclaimer.h"
+#include <atomic>
+#include <cassert>
+using namespace std;
+
+#define CUCKOO_SLOTS 8                  // keys per bucket (a bucket and its version fill one cache line)
+#define CUCKOO_MAX_PATH 256              // displacements an insert tries before it decides the table is full
+#define CUCKOO_CHUNK_BUCKETS 512        // buckets per migration chunk
+#define CUCKOO_MIGRATION_ATTEMPTS 64    // cuckoo paths a migrated key tries before its new table counts as full
+
+/**
+ * Bucketized cuckoo hash table: every key lives in one of two buckets (chosen by the two halves of
+ * murmur3_64), each holding CUCKOO_SLOTS keys in one cache line. A lookup reads exactly those two
+ * lines, at any load (plus the same two in the old table while a resize is running, and again in the
+ * next table if a resize froze them under it).
+ *
+ * Every bucket has a version: odd while a writer holds the bucket, and FROZEN once a resize moved
+ * its keys to the next table. Lookups take no locks: they read both versions, scan both buckets and
+ * retry if a version changed. Writers lock the two buckets they touch (lower index first), and an insert
+ * whose buckets are full first makes room along a cuckoo path: it follows a random walk of keys to
+ * their other bucket until it finds a free slot, and then moves those keys back to front, one locked
+ * pair of buckets at a time (so a moving key is never absent from both of its buckets).
+ *
+ * When no path is found, the table doubles. As in AlgorithmD, threads claim chunks of the old table
+ * and migrate them cooperatively, and an operation first migrates its own key's two old buckets, so
+ * operations do not wait for the whole migration (only for a bucket that is being copied). The next
+ * resize does: startExpansion helps until the current migration is done, since its copies must not
+ * land in frozen buckets.
+ *
+ * Keys are in [1, 0x7FFFFFFF] (0 is EMPTY).
+ */
+class AlgorithmF {
+private:
+    static constexpr int EMPTY = 0;
+    static constexpr uint64_t FROZEN = 1ULL << 63;
+
+    struct alignas(PADDING_BYTES) bucket {
+        std::atomic<uint64_t> version;
+        std::atomic<int> keys[CUCKOO_SLOTS];
+    };
+
+    struct table {
+        alignas(PADDING_BYTES) bucket * buckets;
+        int numBuckets;
+
+        alignas(PADDING_BYTES) table * prev;                   // Table we migrate from (retired once the migration is done)
+        int totalOldChunks;
+
+        alignas(PADDING_BYTES) std::atomic<int> chunksClaimed; // Number of chunks claimed in migration
+        char padding0[PADDING_BYTES - sizeof(std::atomic<int>)];
+
+        alignas(PADDING_BYTES) std::atomic<int> bucketsLeft;   // Old buckets not frozen yet (0: migration complete)
+        char padding1[PADDING_BYTES - sizeof(std::atomic<int>)];
+
+        table(int _numBuckets, table * _prev)
+        : buckets(new bucket[_numBuckets]),
+          numBuckets(_numBuckets),
+          prev(_prev),
+          totalOldChunks(_prev ? (_prev->numBuckets + CUCKOO_CHUNK_BUCKETS - 1) / CUCKOO_CHUNK_BUCKETS : 0),
+          chunksClaimed(0),
+          bucketsLeft(_prev ? _prev->numBuckets : 0)
+        {
+            for (int b = 0; b < numBuckets; b++) {
+                buckets[b].version.store(0, std::memory_order_relaxed);
+                for (int s = 0; s < CUCKOO_SLOTS; s++) buckets[b].keys[s].store(EMPTY, std::memory_order_relaxed);
+            }
+        }
+
+        ~table() {
+            delete[] buckets;
+        }
+    };
+
+    // what an attempt on one table ended with
+    enum { DONE, FOUND, NOT_FOUND, TABLE_FULL, TABLE_REPLACED, RACE };
+
+    char padding0[PADDING_BYTES];
+    const int numThreads;
+    char padding1[PADDING_BYTES];
+    std::atomic<table *> currentTable;
+    char padding2[PADDING_BYTES];
+    EpochReclaimer<table> reclaimer;
+    char padding3[PADDING_BYTES];
+    std::atomic<int> migrationCount;
+    char padding4[PADDING_BYTES];
+    PaddedRandom rngs[MAX_THREADS];                             // picks the keys a cuckoo path displaces
+    debugCounter cuckooMoves;
+    debugCounter abandonedPaths;                                // paths that changed before their moves (other threads, or the path revisiting a bucket)
+
+    static void bucketsOf(table * t, const int & key, int & b1, int & b2);
+    static int otherBucket(table * t, const int & key, int b);
+    static int findSlot(bucket & b, const int & key);
+    bool lockBucket(bucket & b);
+    void unlockBucket(bucket & b);
+    bool lockPair(table * t, int b1, int b2);
+    void unlockPair(table * t, int b1, int b2);
+    int findIn(table * t, const int & key);
+    int insertInto(const int tid, table * t, const int & key);
+    int makeRoom(const int tid, table * t, int b1, int b2);
+    int eraseFrom(table * t, const int & key);
+    void prepare(const int tid, table * t, const int & key);
+    void helpExpansion(const int tid, table * t);
+    int migrateBucket(const int tid, table * t, int b);
+    void finishBuckets(const int tid, table * t, int count);
+    void startExpansion(const int tid, table * t);
+
+public:
+    AlgorithmF(const int _numThreads, const int _capacity);
+    ~AlgorithmF();
+    bool insertIfAbsent(const int tid, const int & key);
+    bool erase(const int tid, const int & key);
+    bool contains(const int tid, const int & key);
+    int insertBatch(const int tid, const int * keys, int n, bool * results);
+    int eraseBatch(const int tid, const int * keys, int n, bool * results);
+    int containsBatch(const int tid, const int * keys, int n, bool * results);
+    long getSumOfKeys();
+    void printDebuggingDetails();
+};
+
+/**
+ * constructor: initialize the hash table's internals
+ *
+ * @param _numThreads maximum number of threads that will ever use the hash table (i.e., at least tid+1, where tid is the largest thread ID passed to any function of this class)
+ * @param _capacity is the INITIAL size of the hash table (maximum number of elements it can contain WITHOUT expansion)
+ */
+AlgorithmF::AlgorithmF(const int _numThreads, const int _capacity)
+: numThreads(_numThreads), reclaimer(_numThreads), migrationCount(0) {
+    int numBuckets = std::max(2, roundCapacity((_capacity + CUCKOO_SLOTS - 1) / CUCKOO_SLOTS));
+    currentTable.store(new table(numBuckets, nullptr));
+    for (int i = 0; i < MAX_THREADS; i++) {
+        rngs[i].setSeed(i + 1);
+    }
+}
+
+// destructor: clean up any allocated memory, etc.
+// (no thread may be inside an operation; tables retired earlier are freed by the reclaimer)
+AlgorithmF::~AlgorithmF() {
+    table * t = currentTable.load();
+    if (t->bucketsLeft.load() > 0)
+        delete t->prev;
+    delete t;
+}
+
+// the two buckets key may live in (always different)
+void AlgorithmF::bucketsOf(table * t, const int & key, int & b1, int & b2) {
+    uint64_t h = murmur3_64((uint32_t) key);
+    b1 = probeIndex((uint32_t) h, 0, t->numBuckets);
+    b2 = probeIndex((uint32_t) (h >> 32), 0, t->numBuckets);
+    if (b2 == b1)
+        b2 = (b1 + 1 == t->numBuckets) ? 0 : b1 + 1;
+}
+
+int AlgorithmF::otherBucket(table * t, const int & key, int b) {
+    int b1, b2;
+    bucketsOf(t, key, b1, b2);
+    return (b == b1) ? b2 : b1;
+}
+
+// slot of b holding key (EMPTY: a free slot), or -1
+int AlgorithmF::findSlot(bucket & b, const int & key) {
+    for (int s = 0; s < CUCKOO_SLOTS; s++) {
+        if (b.keys[s].load(std::memory_order_relaxed) == key)
+            return s;
+    }
+    return -1;
+}
+
+// returns false (without locking) if b is frozen, i.e., its keys live in the next table now
+bool AlgorithmF::lockBucket(bucket & b) {
+    while (true) {
+        uint64_t v = b.version.load(std::memory_order_relaxed);
+        if (v & FROZEN)
+            return false;
+        if (!(v & 1) && b.version.compare_exchange_weak(v, v + 1, std::memory_order_acquire))
+            break;
+    }
+    // readers that see any of our key writes must also see the odd version
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+void AlgorithmF::unlockBucket(bucket & b) {
+    b.version.fetch_add(1, std::memory_order_release);
+}
+
+bool AlgorithmF::lockPair(table * t, int b1, int b2) {
+    int lo = std::min(b1, b2), hi = std::max(b1, b2);
+    if (!lockBucket(t->buckets[lo]))
+        return false;
+    if (!lockBucket(t->buckets[hi])) {
+        unlockBucket(t->buckets[lo]);
+        return false;
+    }
+    return true;
+}
+
+void AlgorithmF::unlockPair(table * t, int b1, int b2) {
+    unlockBucket(t->buckets[b1]);
+    unlockBucket(t->buckets[b2]);
+}
+
+// optimistic search of key's two buckets in t: FOUND, NOT_FOUND, or TABLE_REPLACED if key is not in
+// them but one of them is frozen (its keys are in the next table)
+int AlgorithmF::findIn(table * t, const int & key) {
+    int b1, b2;
+    bucketsOf(t, key, b1, b2);
+    bucket & x = t->buckets[b1];
+    bucket & y = t->buckets[b2];
+    while (true) {
+        uint64_t vx, vy;
+        while ((vx = x.version.load(std::memory_order_acquire)) & 1) {}
+        while ((vy = y.version.load(std::memory_order_acquire)) & 1) {}
+        bool found = (!(vx & FROZEN) && findSlot(x, key) >= 0) || (!(vy & FROZEN) && findSlot(y, key) >= 0);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (x.version.load(std::memory_order_relaxed) == vx && y.version.load(std::memory_order_relaxed) == vy)
+            return found ? FOUND : ((vx | vy) & FROZEN) ? TABLE_REPLACED : NOT_FOUND;
+    }
+}
+
+// one insert attempt on t: DONE, FOUND, TABLE_FULL or TABLE_REPLACED
+int AlgorithmF::insertInto(const int tid, table * t, const int & key) {
+    int b1, b2;
+    bucketsOf(t, key, b1, b2);
+    while (true) {
+        if (!lockPair(t, b1, b2))
+            return TABLE_REPLACED;
+        if (findSlot(t->buckets[b1], key) >= 0 || findSlot(t->buckets[b2], key) >= 0) {
+            unlockPair(t, b1, b2);
+            return FOUND;
+        }
+        int b = b1;
+        int s = findSlot(t->buckets[b1], EMPTY);
+        if (s < 0) {
+            b = b2;
+            s = findSlot(t->buckets[b2], EMPTY);
+        }
+        if (s >= 0) {
+            t->buckets[b].keys[s].store(key, std::memory_order_relaxed);
+            unlockPair(t, b1, b2);
+            return DONE;
+        }
+        unlockPair(t, b1, b2);
+
+        int room = makeRoom(tid, t, b1, b2);
+        if (room != DONE && room != RACE)
+            return room;
+    }
+}
+
+/**
+ * Frees a slot in b1 or b2 (neither locked by the caller): walks a random cuckoo path from one of
+ * them until a key's other bucket has a free slot, then moves the keys on the path, last one first.
+ * The walk reads without locks, so every move re-checks its key under the locks of both buckets.
+ *
+ * @return DONE (someone may still take the slot before the caller gets there), RACE (a move found
+ * the path changed), TABLE_FULL (no free slot within CUCKOO_MAX_PATH steps) or TABLE_REPLACED
+ */
+int AlgorithmF::makeRoom(const int tid, table * t, int b1, int b2) {
+    int pathBucket[CUCKOO_MAX_PATH], pathSlot[CUCKOO_MAX_PATH], pathKey[CUCKOO_MAX_PATH];
+    int b = (rngs[tid].nextNatural() & 1) ? b1 : b2;
+    int length = 0;
+    while (true) {
+        if (length == CUCKOO_MAX_PATH)
+            return TABLE_FULL;
+        int s = rngs[tid].nextNatural() % CUCKOO_SLOTS;
+        int victim = t->buckets[b].keys[s].load(std::memory_order_relaxed);
+        if (victim == EMPTY)
+            break;      // a slot on the path freed up meanwhile: the moves so far end here
+        pathBucket[length] = b;
+        pathSlot[length] = s;
+        pathKey[length] = victim;
+        length++;
+        b = otherBucket(t, victim, b);
+        if (findSlot(t->buckets[b], EMPTY) >= 0)
+            break;
+    }
+
+    for (int i = length - 1; i >= 0; i--) {
+        int from = pathBucket[i];
+        int to = otherBucket(t, pathKey[i], from);
+        if (!lockPair(t, from, to))
+            return TABLE_REPLACED;
+        int free = findSlot(t->buckets[to], EMPTY);
+        if (t->buckets[from].keys[pathSlot[i]].load(std::memory_order_relaxed) != pathKey[i] || free < 0) {
+            unlockPair(t, from, to);
+            abandonedPaths.inc(tid);
+            return RACE;
+        }
+        t->buckets[to].keys[free].store(pathKey[i], std::memory_order_relaxed);
+        t->buckets[from].keys[pathSlot[i]].store(EMPTY, std::memory_order_relaxed);
+        unlockPair(t, from, to);
+        cuckooMoves.inc(tid);
+    }
+    return DONE;
+}
+
+// one erase attempt on t: FOUND, NOT_FOUND or TABLE_REPLACED
+int AlgorithmF::eraseFrom(table * t, const int & key) {
+    int b1, b2;
+    bucketsOf(t, key, b1, b2);
+    if (!lockPair(t, b1, b2))
+        return TABLE_REPLACED;
+    int ret = NOT_FOUND;
+    for (int b : { b1, b2 }) {
+        int s = findSlot(t->buckets[b], key);
+        if (s >= 0) {
+            t->buckets[b].keys[s].store(EMPTY, std::memory_order_relaxed);
+            ret = FOUND;
+            break;
+        }
+    }
+    unlockPair(t, b1, b2);
+    return ret;
+}
+
+// before a write to t: help with t's migration, and make sure key's old buckets have been moved to t
+void AlgorithmF::prepare(const int tid, table * t, const int & key) {
+    if (t->bucketsLeft.load() == 0)
+        return;
+    helpExpansion(tid, t);
+    int b1, b2;
+    bucketsOf(t->prev, key, b1, b2);
+    finishBuckets(tid, t, migrateBucket(tid, t, b1) + migrateBucket(tid, t, b2));
+}
+
+void AlgorithmF::helpExpansion(const int tid, table * t) {
+    while (t->chunksClaimed.load() < t->totalOldChunks) {
+        int myChunk = t->chunksClaimed.fetch_add(1);
+        if (myChunk >= t->totalOldChunks)
+            break;
+        int start = myChunk * CUCKOO_CHUNK_BUCKETS;
+        int end = std::min(start + CUCKOO_CHUNK_BUCKETS, t->prev->numBuckets);
+        int frozen = 0;
+        for (int b = start; b < end; b++) {
+            frozen += migrateBucket(tid, t, b);
+        }
+        finishBuckets(tid, t, frozen);
+    }
+}
+
+/**
+ * Moves the keys of old bucket b into t and freezes b. The thread that locks b is the only one
+ * that copies it; it holds the lock while copying, so the keys are in t by the time anyone sees
+ * FROZEN. Writers of the old table back off from a frozen bucket, and readers ignore its keys.
+ *
+ * @return 1 if this call froze b (the caller reports it to finishBuckets), else 0
+ */
+int AlgorithmF::migrateBucket(const int tid, table * t, int b) {
+    bucket & old = t->prev->buckets[b];
+    if (!lockBucket(old))
+        return 0;
+    for (int s = 0; s < CUCKOO_SLOTS; s++) {
+        int key = old.keys[s].load(std::memory_order_relaxed);
+        if (key == EMPTY)
+            continue;
+        // t has twice the old buckets, but user inserts land in t while the migration runs, so t can fill
+        // up before the last old bucket is copied. Other random paths may still get through; if none does,
+        // the key has nowhere to go (the next resize waits for this migration, and b stays locked).
+        int result = TABLE_FULL;
+        for (int attempt = 0; attempt < CUCKOO_MIGRATION_ATTEMPTS && result == TABLE_FULL; attempt++)
+            result = insertInto(tid, t, key);
+        if (result != DONE) {
+            fprintf(stderr, "ERROR: no room left in the new table for key %d of the old one (%d buckets)\n", key, t->numBuckets);
+            abort();
+        }
+    }
+    old.version.store((old.version.load(std::memory_order_relaxed) + 1) | FROZEN, std::memory_order_release);
+    return 1;
+}
+
+void AlgorithmF::finishBuckets(const int tid, table * t, int count) {
+    if (count > 0 && t->bucketsLeft.fetch_sub(count) == count) {
+        // last old bucket frozen: nobody will read the old table through t again
+        reclaimer.retire(tid, t->prev);
+    }
+}
+
+// installs a table with twice as many buckets as t (if t is still the current table)
+void AlgorithmF::startExpansion(const int tid, table * t) {
+    // the next resize waits for the current one: its copies must not land in frozen buckets
+    while (t->bucketsLeft.load() > 0) {
+        helpExpansion(tid, t);
+    }
+    if (currentTable.load() != t)
+        return;
+    table * t_new = new table(roundCapacity(2 * t->numBuckets), t);
+    if (currentTable.compare_exchange_strong(t, t_new)) {
+        migrationCount++;
+    } else {
+        delete t_new;   // never published, so it can be freed right away
+    }
+}
+
+// semantics: try to insert key. return true if successful (if key doesn't already exist), and false otherwise
+bool AlgorithmF::insertIfAbsent(const int tid, const int & key) {
+    EpochGuard<table> guard(reclaimer, tid);
+    while (true) {
+        table * t = currentTable.load();
+        prepare(tid, t, key);
+        int result = insertInto(tid, t, key);
+        if (result == DONE)
+            return true;
+        if (result == FOUND)
+            return false;
+        if (result == TABLE_FULL)
+            startExpansion(tid, t);
+        // TABLE_REPLACED: retry on the new table
+    }
+}
+
+// semantics: try to erase key. return true if successful, and false otherwise
+bool AlgorithmF::erase(const int tid, const int & key) {
+    EpochGuard<table> guard(reclaimer, tid);
+    while (true) {
+        table * t = currentTable.load();
+        prepare(tid, t, key);
+        int result = eraseFrom(t, key);
+        if (result != TABLE_REPLACED)
+            return result == FOUND;
+    }
+}
+
+// semantics: return true if key is in the set, and false otherwise
+// (no locks, no helping: while a migration is running, key's unfrozen old buckets are read too, and
+// if the next resize freezes key's buckets in t meanwhile, the lookup starts over on the new table)
+bool AlgorithmF::contains(const int tid, const int & key) {
+    EpochGuard<table> guard(reclaimer, tid);
+    while (true) {
+        table * t = currentTable.load();
+        // (a frozen old bucket has its keys in t already)
+        if (t->bucketsLeft.load() > 0 && findIn(t->prev, key) == FOUND)
+            return true;
+        int result = findIn(t, key);
+        if (result != TABLE_REPLACED)
+            return result == FOUND;
+    }
+}
+
+// semantics: results[j] = insertIfAbsent(tid, keys[j]) for every j < n, in order; returns how many are true
+// (see runBatch: the first buckets of upcoming keys are prefetched while earlier ones are inserted)
+int AlgorithmF::insertBatch(const int tid, const int * keys, int n, bool * results) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table * t = currentTable.load();
+    int b1, b2;
+    return runBatch<true>(n, results, [&](int j) { bucketsOf(t, keys[j], b1, b2); return &t->buckets[b1]; },
+                                      [&](int j) { return insertIfAbsent(tid, keys[j]); });
+}
+
+// semantics: results[j] = erase(tid, keys[j]) for every j < n, in order; returns how many are true
+int AlgorithmF::eraseBatch(const int tid, const int * keys, int n, bool * results) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table * t = currentTable.load();
+    int b1, b2;
+    return runBatch<true>(n, results, [&](int j) { bucketsOf(t, keys[j], b1, b2); return &t->buckets[b1]; },
+                                      [&](int j) { return erase(tid, keys[j]); });
+}
+
+// semantics: results[j] = contains(tid, keys[j]) for every j < n; returns how many are true
+int AlgorithmF::containsBatch(const int tid, const int * keys, int n, bool * results) {
+    EpochGuard<table> guard(reclaimer, tid);
+    table * t = currentTable.load();
+    int b1, b2;
+    return runBatch<false>(n, results, [&](int j) { bucketsOf(t, keys[j], b1, b2); return &t->buckets[b1]; },
+                                       [&](int j) { return contains(tid, keys[j]); });
+}
+
+// semantics: return the sum of all KEYS in the set
+int64_t AlgorithmF::getSumOfKeys() {
+    table * t = currentTable.load();
+    // (bucket ranges in parallel, see parallelSum in util.h)
+    int64_t sum = parallelSum(t->numBuckets, [&](int64_t begin, int64_t end) {
+        auto buckets = t->buckets;  // (the atomic loads would make the compiler reload t->buckets on every slot)
+        int64_t chunkSum = 0;
+        for (int64_t b = begin; b < end; b++) {
+            for (int s = 0; s < CUCKOO_SLOTS; s++) chunkSum += buckets[b].keys[s].load(std::memory_order_relaxed);
+        }
+        return chunkSum;
+    });
+    // an unfinished migration leaves keys in the old table's unfrozen buckets
+    if (t->bucketsLeft.load() > 0) {
+        sum += parallelSum(t->prev->numBuckets, [&](int64_t begin, int64_t end) {
+            auto buckets = t->prev->buckets;
+            int64_t chunkSum = 0;
+            for (int64_t b = begin; b < end; b++) {
+                if (buckets[b].version.load() & FROZEN) continue;
+                for (int s = 0; s < CUCKOO_SLOTS; s++) chunkSum += buckets[b].keys[s].load(std::memory_order_relaxed);
+            }
+            return chunkSum;
+        });
+    }
+    return sum;
+}
+
+// print any debugging details you want at the end of a trial in this function
+void AlgorithmF::printDebuggingDetails() {
+    table * t = currentTable.load();
+    int64_t keys = 0;
+    for (int b = 0; b < t->numBuckets; b++) {
+        for (int s = 0; s < CUCKOO_SLOTS; s++) keys += (t->buckets[b].keys[s].load(std::memory_order_relaxed) != EMPTY);
+    }
+    cout<<"migrations: "<<migrationCount<<endl;
+    cout<<"current capacity: "<<(int64_t) t->numBuckets * CUCKOO_SLOTS<<" ("<<t->numBuckets<<" buckets of "<<CUCKOO_SLOTS<<")"<<endl;
+    cout<<"load factor: "<<(double) keys / ((int64_t) t->numBuckets * CUCKOO_SLOTS)<<endl;
+    cout<<"cuckoo moves: "<<cuckooMoves.getTotal()<<" (paths abandoned: "<<abandonedPaths.getTotal()<<")"<<endl;
+    cout<<"retired tables not yet freed: "<<reclaimer.getPendingCount()<<endl;
+}
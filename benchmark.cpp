@@ -9,15 +9,38 @@
 #include <cstring>
 #include <iostream>
 #include <time.h>
+#include <chrono>
 
 #include "util.h"
 #include "alg_a.h"
+#include "alg_a_striped.h"
 #include "alg_b.h"
 #include "alg_c.h"
+#include "alg_e.h"
+#include "alg_f.h"
 #include "alg_d.h"
+#include "alg_d_map.h"
+#include "workload.h"
 
 using namespace std;
 
+// what the worker threads do: the operation mix (percentages add up to 100) and how keys are drawn
+struct workload_t {
+    double lookupPercent;
+    double insertPercent;
+    double erasePercent;
+    KeyDistributionType dist;
+    double zipfTheta;
+    double hotOpPercent;
+    double hotKeyPercent;
+    int batchSize;              // > 1: every operation is a batched one (insertBatch, ...) on this many consecutive stream keys
+};
+
+#define MAX_BATCH_SIZE 1024
+
+enum { OP_LOOKUP, OP_INSERT, OP_ERASE, NUM_OP_TYPES };
+const char * opTypeNames[NUM_OP_TYPES] = { "lookup", "insert", "erase" };
+
 template <class DataStructureType>
 struct globals_t {
     PaddedRandom rngs[MAX_THREADS];
@@ -35,13 +58,23 @@ struct globals_t {
     DataStructureType * ds;
     debugCounter numTotalOps;   // already has padding built in at the beginning and end
     debugCounter keyChecksum;
+    debugCounter numLookups;
+    debugCounter numLookupHits;
+    debugCounter numValueErrors;    // key-value tables only: lookups that returned a value belonging to another key
     int millisToRun;
     int totalThreads;
     int keyRangeSize;
     int tableSize;
+    double lookupFraction;      // fraction of operations that are contains()
+    double insertFraction;      // ... and inserts; the rest are erases
+    int batchSize;
+    keyDistribution * keyDist;
+    int * keyStreams[MAX_THREADS];  // generated by each thread before the timer starts
+    bool measureLatency;
+    latencyHistogram * latency[NUM_OP_TYPES][2];    // nanoseconds per operation, by operation type and [1] iff it overlapped a resize
     volatile char padding7[PADDING_BYTES];
     
-    globals_t(int _millisToRun, int _totalThreads, int _keyRangeSize, int _tableSize, DataStructureType * _ds) {
+    globals_t(int _millisToRun, int _totalThreads, int _keyRangeSize, int _tableSize, const workload_t & w, bool _measureLatency, DataStructureType * _ds) {
         for (int i=0;i<MAX_THREADS;++i) {
             rngs[i].setSeed(i+1); // +1 because we don't want thread 0 to get a seed of 0, since seeds of 0 usually mean all random numbers are zero...
         }
@@ -54,9 +87,26 @@ struct globals_t {
         totalThreads = _totalThreads;
         keyRangeSize = _keyRangeSize;
         tableSize = _tableSize;
+        lookupFraction = w.lookupPercent / 100.;
+        insertFraction = w.insertPercent / 100.;
+        batchSize = w.batchSize;
+        keyDist = new keyDistribution(w.dist, keyRangeSize, w.zipfTheta, w.hotOpPercent / 100., w.hotKeyPercent / 100.);
+        for (int i=0;i<MAX_THREADS;++i) keyStreams[i] = NULL;
+        measureLatency = _measureLatency;
+        for (int op=0;op<NUM_OP_TYPES;++op) {
+            for (int inResize=0;inResize<2;++inResize) {
+                latency[op][inResize] = measureLatency ? new latencyHistogram(totalThreads) : NULL;
+            }
+        }
     }
     ~globals_t() {
         delete ds;
+        delete keyDist;
+        for (int i=0;i<MAX_THREADS;++i) delete[] keyStreams[i];
+        for (int op=0;op<NUM_OP_TYPES;++op) {
+            delete latency[op][0];
+            delete latency[op][1];
+        }
     }
 } __attribute__((aligned(PADDING_BYTES)));
 
@@ -64,13 +114,107 @@ void printUpdatedThroughput(auto g, int64_t elapsedNow) {
     auto opsNow = g->numTotalOps.getTotal();
     cout<<elapsedNow <<"ms: "<<opsNow<<" total_ops"<<endl;
     cout<<elapsedNow <<"ms: "<<(opsNow * 1000 / elapsedNow)<<" throughput"<<endl;
+    cout<<elapsedNow <<"ms: "<<(getResidentBytes() >> 20)<<" rss_mb"<<endl;
+}
+
+/**
+ * The worker loop is written against the set interface (insertIfAbsent, erase, contains).
+ * Key-value tables overload these adapters, which turns the same loop into a get/put workload.
+ */
+template <class DataStructureType, typename KeyType>
+bool doInsert(DataStructureType * ds, int tid, KeyType key, int cnt) {
+    return ds->insertIfAbsent(tid, key);
+}
+
+template <class DataStructureType, typename KeyType>
+bool doLookup(DataStructureType * ds, int tid, KeyType key, bool & valueOk) {
+    return ds->contains(tid, key);
+}
+
+// maps a generated key in [1, keyRangeSize] to the key the data structure sees
+template <class DataStructureType>
+int toTableKey(DataStructureType * ds, int key) {
+    return key;
+}
+
+// 64-bit tables get keys above the 32-bit range, so the high half is exercised too
+int64_t toTableKey(AlgorithmD<int64_t> * ds, int key) {
+    return (1LL << 32) + key;
+}
+
+// put: the low 16 bits of every value repeat the key's, so a get can check that values travel with their keys
+bool doInsert(AlgorithmDMap * ds, int tid, int key, int cnt) {
+    return ds->upsert(tid, key, (cnt << 16) | (key & 0xFFFF));
+}
+
+bool doLookup(AlgorithmDMap * ds, int tid, int key, bool & valueOk) {
+    int value;
+    if (!ds->get(tid, key, value)) return false;
+    valueOk = ((value & 0xFFFF) == (key & 0xFFFF));
+    return true;
+}
+
+// runs one batched operation; returns the number of keys it succeeded for (per key: results)
+template <class DataStructureType, typename KeyType>
+int doBatch(DataStructureType * ds, int tid, int opType, const KeyType * keys, int n, bool * results, int cnt) {
+    if (opType == OP_LOOKUP) return ds->containsBatch(tid, keys, n, results);
+    if (opType == OP_INSERT) return ds->insertBatch(tid, keys, n, results);
+    return ds->eraseBatch(tid, keys, n, results);
+}
+
+// the key-value table has no batched operations: its batches are single operations in a row (values are not checked)
+int doBatch(AlgorithmDMap * ds, int tid, int opType, const int * keys, int n, bool * results, int cnt) {
+    int ret = 0;
+    for (int j = 0; j < n; j++) {
+        bool valueOk = true;
+        if (opType == OP_LOOKUP) results[j] = doLookup(ds, tid, keys[j], valueOk);
+        else if (opType == OP_INSERT) results[j] = doInsert(ds, tid, keys[j], cnt);
+        else results[j] = ds->erase(tid, keys[j]);
+        ret += results[j];
+    }
+    return ret;
 }
 
+// changes whenever a resize starts or completes, and is odd while one is running (tables that never resize: always 0)
 template <class DataStructureType>
-void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalThreads) {
+int64_t getResizeStamp(DataStructureType * ds, int tid) {
+    return 0;
+}
+
+template <typename K>
+int64_t getResizeStamp(AlgorithmD<K> * ds, int tid) {
+    return ds->getResizeStamp(tid);
+}
+
+int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// one line per operation type and phase (steady state vs. overlapping a resize), all in nanoseconds
+void printLatencyTable(latencyHistogram * latency[NUM_OP_TYPES][2]) {
+    printf("%-22s %10s %8s %8s %8s %8s %12s\n", "latency (ns)", "ops", "p50", "p90", "p99", "p99.9", "max");
+    for (int op=0;op<NUM_OP_TYPES;++op) {
+        for (int inResize=0;inResize<2;++inResize) {
+            latencyHistogram * h = latency[op][inResize];
+            if (h->getCount() == 0) continue;
+            char label[32];
+            snprintf(label, sizeof(label), "%s%s", opTypeNames[op], inResize ? " (in resize)" : "");
+            printf("%-22s %10llu %8llu %8llu %8llu %8llu %12llu\n", label,
+                    (unsigned long long) h->getCount(),
+                    (unsigned long long) h->getPercentile(0.5),
+                    (unsigned long long) h->getPercentile(0.9),
+                    (unsigned long long) h->getPercentile(0.99),
+                    (unsigned long long) h->getPercentile(0.999),
+                    (unsigned long long) h->getMax());
+        }
+    }
+}
+
+template <class DataStructureType>
+void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalThreads, const workload_t & w, bool measureLatency) {
     // create globals struct that all threads will access (with padding to prevent false sharing on control logic meta data)
     auto dataStructure = new DataStructureType(totalThreads, tableSize);
-    auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, tableSize, dataStructure);
+    auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, tableSize, w, measureLatency, dataStructure);
     
     /**
      * 
@@ -84,12 +228,17 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
         threads[tid] = new thread([&, tid]() { /* access all variables by reference, except tid, which we copy (since we don't want our tid to be a reference to the changing loop variable) */
                 const int OPS_BETWEEN_TIME_CHECKS = 500; // only check the current time (to see if we should stop) once every X operations, to amortize the overhead of time checking
 
+                // generate this thread's keys up front, so drawing them is not part of the measured time
+                g->keyStreams[tid] = new int[KEY_STREAM_LENGTH];
+                g->keyDist->fillStream(tid, g->totalThreads, g->rngs[tid], g->keyStreams[tid], KEY_STREAM_LENGTH);
+
                 // BARRIER WAIT
                 g->running.fetch_add(1);
                 while (!g->start) { TRACE TPRINT("waiting to start"); } // wait to start
                 
+                const int batchesBetweenTimeChecks = std::max(1, OPS_BETWEEN_TIME_CHECKS / g->batchSize);
                 for (int cnt=0; !g->done; ++cnt) {
-                    if ((cnt % OPS_BETWEEN_TIME_CHECKS) == 0                    // once every X operations
+                    if ((cnt % batchesBetweenTimeChecks) == 0                    // once every X operations
                         && g->timer.getElapsedMillis() >= g->millisToRun) {   // check how much time has passed
                             g->done = true; // set global "done" bit flag, so all threads know to stop on the next operation (first guy to stop dictates when everyone else stops --- at most one more operation is performed per thread!)
                             __sync_synchronize(); // flush the write to g->done so other threads see it immediately (mostly paranoia, since volatile writes should be flushed, and also our next step will be a fetch&add which is an implied flush on intel/amd)
@@ -97,23 +246,67 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
 
                     VERBOSE if (cnt&&((cnt % 1000000) == 0)) TPRINT("op# "<<cnt);
                     
-                    // flip a coin to decide: insert or erase?
+                    // flip a coin to decide: lookup, insert or erase?
                     // generate a random double in [0, 1]
                     double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max();
                     //cout<<"operationType="<<operationType<<endl;
                     
-                    // generate random key
-                    int key = 1 + (g->rngs[tid].nextNatural() % g->keyRangeSize);
+                    if (g->batchSize > 1) {
+                        // the next batchSize keys of this thread's stream, all with the same operation
+                        decltype(toTableKey(g->ds, 0)) keys[MAX_BATCH_SIZE];
+                        bool results[MAX_BATCH_SIZE];
+                        for (int j = 0; j < g->batchSize; j++) {
+                            keys[j] = toTableKey(g->ds, g->keyStreams[tid][((int64_t) cnt * g->batchSize + j) & (KEY_STREAM_LENGTH - 1)]);
+                        }
+                        int opType = (operationType < g->lookupFraction) ? OP_LOOKUP
+                                   : (operationType < g->lookupFraction + g->insertFraction) ? OP_INSERT : OP_ERASE;
+                        int succeeded = doBatch(g->ds, tid, opType, keys, g->batchSize, results, cnt);
+                        if (opType == OP_LOOKUP) {
+                            g->numLookups.add(tid, g->batchSize);
+                            g->numLookupHits.add(tid, succeeded);
+                        } else {
+                            for (int j = 0; j < g->batchSize; j++) {
+                                if (results[j]) g->keyChecksum.add(tid, opType == OP_INSERT ? keys[j] : -keys[j]);
+                            }
+                        }
+                        g->numTotalOps.add(tid, g->batchSize);
+                        continue;
+                    }
+                    
+                    // next key of this thread's stream
+                    auto key = toTableKey(g->ds, g->keyStreams[tid][cnt & (KEY_STREAM_LENGTH - 1)]);
                     
-                    // insert or delete this key
-                    if (operationType < 0.5) {
-                        auto result = g->ds->insertIfAbsent(tid, key);
+                    int64_t stampBefore = 0, startNanos = 0;
+                    if (g->measureLatency) {
+                        stampBefore = getResizeStamp(g->ds, tid);
+                        startNanos = nowNanos();
+                    }
+                    
+                    // look up, insert or delete this key
+                    int opType;
+                    if (operationType < g->lookupFraction) {
+                        opType = OP_LOOKUP;
+                        bool valueOk = true;
+                        auto result = doLookup(g->ds, tid, key, valueOk);
+                        g->numLookups.inc(tid);
+                        if (result) g->numLookupHits.inc(tid);
+                        if (!valueOk) g->numValueErrors.inc(tid);
+                    } else if (operationType < g->lookupFraction + g->insertFraction) {
+                        opType = OP_INSERT;
+                        auto result = doInsert(g->ds, tid, key, cnt);
                         if (result) g->keyChecksum.add(tid, key);
                     } else {
+                        opType = OP_ERASE;
                         auto result = g->ds->erase(tid, key);
                         if (result) g->keyChecksum.add(tid, -key);
                     }
                     
+                    if (g->measureLatency) {
+                        auto nanos = nowNanos() - startNanos;
+                        bool overlappedResize = (stampBefore & 1) || getResizeStamp(g->ds, tid) != stampBefore;
+                        g->latency[opType][overlappedResize]->record(tid, nanos);
+                    }
+                    
                     g->numTotalOps.inc(tid);
                 }
                 
@@ -138,6 +331,7 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
     // and print throughput update every 1s
     
     int64_t lastTime = 0;
+    int64_t steadyStateRss = getResidentBytes();
     while (g->running > 0) {
         // sleep for 0.1s
         timespec time_to_sleep;
@@ -151,6 +345,8 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
             printUpdatedThroughput(g, elapsedNow);
         }
         lastTime = elapsedNow;
+        steadyStateRss = getResidentBytes(); // last sample taken while the threads are still working
+
     }
     
     // measure and print elapsed time
@@ -187,6 +383,10 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
         cout<<"ERROR: validation failed!"<<endl;
         exit(-1);
     }
+    if (g->numValueErrors.getTotal() > 0) {
+        cout<<"ERROR: validation failed! "<<g->numValueErrors.getTotal()<<" lookups returned a value that does not belong to their key"<<endl;
+        exit(-1);
+    }
     
     cout<<"individual thread ops :";
     for (int i=0;i<g->totalThreads;++i) {
@@ -194,22 +394,340 @@ void runExperiment(int keyRangeSize, int tableSize, int millisToRun, int totalTh
     }
     cout<<endl;
     cout<<"total completed ops   : "<<numTotalOps<<endl;
+    if (g->lookupFraction > 0) {
+        auto numLookups = g->numLookups.getTotal();
+        cout<<"lookup ops            : "<<numLookups<<endl;
+        cout<<"lookup hit ratio      : "<<(numLookups ? g->numLookupHits.getTotal() / (double) numLookups : 0)<<endl;
+    }
     cout<<"throughput            : "<<(long long) (numTotalOps * 1000. / g->elapsedMillis)<<endl;
     cout<<"elapsed milliseconds  : "<<g->elapsedMillis<<endl;
+    cout<<"peak rss (MB)         : "<<(getPeakResidentBytes() >> 20)<<endl;
+    cout<<"steady-state rss (MB) : "<<(steadyStateRss >> 20)<<endl;
+    if (g->measureLatency) {
+        printLatencyTable(g->latency);
+    }
     cout<<endl;
     
     delete g;
 }
 
+// runs f(tid) on totalThreads threads and waits for all of them
+template <typename F>
+void runOnAllThreads(int totalThreads, F f) {
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() { f(tid); });
+    }
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+}
+
+// prints resident memory and how long a full scan of the table (getSumOfKeys) takes
+template <class DataStructureType>
+int64_t printShrinkPhase(DataStructureType * ds, const char * phase) {
+    auto scanStart = std::chrono::high_resolution_clock::now();
+    auto sum = ds->getSumOfKeys();
+    auto scanMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - scanStart).count();
+    cout<<phase<<": rss (MB)          : "<<(getResidentBytes() >> 20)<<endl;
+    cout<<phase<<": scan microseconds : "<<scanMicros<<endl;
+    ds->printDebuggingDetails();
+    cout<<endl;
+    return sum;
+}
+
+/**
+ * Grow/shrink experiment: the threads insert every key in [1, keyRangeSize], then erase 90% of them.
+ * After each phase we report memory and full-scan time, which shows whether the table gave space back.
+ */
+template <class DataStructureType>
+void runShrinkExperiment(int keyRangeSize, int tableSize, int totalThreads) {
+    auto ds = new DataStructureType(totalThreads, tableSize);
+    debugCounter keyChecksum;
+    keyChecksum.clear();
+
+    runOnAllThreads(totalThreads, [&](int tid) {
+        for (int k = 1 + tid; k <= keyRangeSize; k += totalThreads) {
+            auto key = toTableKey(ds, k);
+            if (doInsert(ds, tid, key, 0)) keyChecksum.add(tid, key);
+        }
+    });
+    printShrinkPhase(ds, "grown");
+
+    runOnAllThreads(totalThreads, [&](int tid) {
+        for (int k = 1 + tid; k <= keyRangeSize; k += totalThreads) {
+            if (k % 10 == 0) continue;
+            auto key = toTableKey(ds, k);
+            if (ds->erase(tid, key)) keyChecksum.add(tid, -key);
+        }
+    });
+    auto dsSumOfKeys = printShrinkPhase(ds, "shrunk");
+
+    auto threadsSumOfKeys = keyChecksum.getTotal();
+    cout<<"Validation: sum of keys according to the data structure = "<<dsSumOfKeys<<" and sum of keys according to the threads = "<<threadsSumOfKeys<<".";
+    cout<<((threadsSumOfKeys == dsSumOfKeys) ? " OK." : " FAILED.")<<endl;
+    if (threadsSumOfKeys != dsSumOfKeys) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+    cout<<"peak rss (MB)         : "<<(getPeakResidentBytes() >> 20)<<endl;
+    cout<<endl;
+
+    delete ds;
+}
+
+/**
+ * Probe-cost experiment: the threads insert the odd keys of [1, keyRangeSize], then each one looks up
+ * PROBE_LOOKUPS_PER_THREAD uniform random keys of the range (about half of them hits).
+ * Reports nanoseconds per lookup, which is dominated by index computation and probing.
+ */
+#define PROBE_LOOKUPS_PER_THREAD (1 << 22)
+template <class DataStructureType>
+void runProbeExperiment(int keyRangeSize, int tableSize, int totalThreads, int batchSize) {
+    auto ds = new DataStructureType(totalThreads, tableSize);
+    runOnAllThreads(totalThreads, [&](int tid) {
+        for (int k = 1 + 2 * tid; k <= keyRangeSize; k += 2 * totalThreads) {
+            doInsert(ds, tid, toTableKey(ds, k), 0);
+        }
+    });
+
+    debugCounter hits;
+    auto start = std::chrono::high_resolution_clock::now();
+    runOnAllThreads(totalThreads, [&](int tid) {
+        PaddedRandom rng(tid + 1);
+        long long myHits = 0;
+        if (batchSize > 1) {
+            decltype(toTableKey(ds, 0)) keys[MAX_BATCH_SIZE];
+            bool results[MAX_BATCH_SIZE];
+            for (int i = 0; i < PROBE_LOOKUPS_PER_THREAD; i += batchSize) {
+                int n = std::min(batchSize, PROBE_LOOKUPS_PER_THREAD - i);
+                for (int j = 0; j < n; j++) keys[j] = toTableKey(ds, 1 + rng.nextNatural() % keyRangeSize);
+                myHits += doBatch(ds, tid, OP_LOOKUP, keys, n, results, 0);
+            }
+        } else {
+            for (int i = 0; i < PROBE_LOOKUPS_PER_THREAD; i++) {
+                bool valueOk = true;
+                myHits += doLookup(ds, tid, toTableKey(ds, 1 + rng.nextNatural() % keyRangeSize), valueOk);
+            }
+        }
+        hits.add(tid, myHits);
+    });
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+    const char * indexing[] = { "modulo", "mask", "fastrange" };
+    cout<<"probe indexing        : "<<indexing[PROBE_INDEXING]<<endl;
+    cout<<"lookups per batch     : "<<batchSize<<endl;
+    cout<<"group probing (D)     : "<<(GROUP_PROBING ? "on, " + to_string(GROUP_WIDTH) + " tags per compare" : string("off"))<<endl;
+    cout<<"lookups               : "<<(long long) PROBE_LOOKUPS_PER_THREAD * totalThreads<<" (hit ratio "<<hits.getTotal() / ((double) PROBE_LOOKUPS_PER_THREAD * totalThreads)<<")"<<endl;
+    cout<<"ns per lookup (thread): "<<(double) nanos * totalThreads / ((double) PROBE_LOOKUPS_PER_THREAD * totalThreads)<<endl;
+    ds->printDebuggingDetails();
+    cout<<endl;
+
+    delete ds;
+}
+
+// fills an empty table with keys[0..n): tables without a bulk load get n inserts, spread over totalThreads threads
+template <class DataStructureType, typename KeyType>
+void doBulkLoad(DataStructureType * ds, int totalThreads, const KeyType * keys, int64_t n) {
+    runOnAllThreads(totalThreads, [&](int tid) {
+        for (int64_t j = tid; j < n; j += totalThreads) {
+            doInsert(ds, tid, keys[j], 0);
+        }
+    });
+}
+
+template <typename K>
+void doBulkLoad(AlgorithmD<K> * ds, int totalThreads, const K * keys, int64_t n) {
+    ds->bulkLoad(0, keys, n);
+}
+
+// snapshot files: tables without saveSnapshot/loadSnapshot report failure
+template <class DataStructureType>
+bool doSaveSnapshot(DataStructureType * ds, const char * path) {
+    return false;
+}
+
+template <class DataStructureType>
+bool doLoadSnapshot(DataStructureType * ds, const char * path, bool verifyChecksum) {
+    return false;
+}
+
+template <typename K>
+bool doSaveSnapshot(AlgorithmD<K> * ds, const char * path) {
+    return ds->saveSnapshot(0, path);
+}
+
+template <typename K>
+bool doLoadSnapshot(AlgorithmD<K> * ds, const char * path, bool verifyChecksum) {
+    return ds->loadSnapshot(0, path, verifyChecksum);
+}
+
+// every key of [1, keyRangeSize] (as the table sees it), in random order; sets expectedSum to their sum
+template <class DataStructureType>
+auto shuffledKeyRange(int keyRangeSize, int64_t & expectedSum) {
+    auto noDs = (DataStructureType *) nullptr;
+    std::vector<decltype(toTableKey(noDs, 0))> keys(keyRangeSize);
+    expectedSum = 0;
+    for (int k = 1; k <= keyRangeSize; k++) {
+        keys[k - 1] = toTableKey(noDs, k);
+        expectedSum += keys[k - 1];
+    }
+    PaddedRandom rng(1);
+    for (int j = keyRangeSize - 1; j > 0; j--) {
+        std::swap(keys[j], keys[rng.nextNatural() % (j + 1)]);
+    }
+    return keys;
+}
+
+void validateSum(int64_t dsSumOfKeys, int64_t expectedSum) {
+    cout<<"Validation: sum of keys according to the data structure = "<<dsSumOfKeys<<" and sum of keys expected = "<<expectedSum<<".";
+    cout<<((expectedSum == dsSumOfKeys) ? " OK." : " FAILED.")<<endl;
+    if (expectedSum != dsSumOfKeys) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(-1);
+    }
+}
+
+/**
+ * Cold-start build experiment: every key of [1, keyRangeSize], in random order, goes into a fresh table
+ * of initial size tableSize, once through inserts from all threads and once through the bulk load.
+ * Reports how long each build took, and validates both tables.
+ */
+template <class DataStructureType>
+void runBuildExperiment(int keyRangeSize, int tableSize, int totalThreads) {
+    int64_t expectedSum;
+    auto keys = shuffledKeyRange<DataStructureType>(keyRangeSize, expectedSum);
+
+    for (int bulk = 0; bulk < 2; bulk++) {
+        auto ds = new DataStructureType(totalThreads, tableSize);
+        auto start = std::chrono::high_resolution_clock::now();
+        if (bulk) {
+            doBulkLoad(ds, totalThreads, keys.data(), keyRangeSize);
+        } else {
+            runOnAllThreads(totalThreads, [&](int tid) {
+                for (int j = tid; j < keyRangeSize; j += totalThreads) {
+                    doInsert(ds, tid, keys[j], 0);
+                }
+            });
+        }
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        cout<<(bulk ? "build ms (bulk load)  : " : "build ms (inserts)    : ")<<millis<<endl;
+        ds->printDebuggingDetails();
+
+        validateSum(ds->getSumOfKeys(), expectedSum);
+        cout<<endl;
+        delete ds;
+    }
+}
+
+/**
+ * Restart experiment: a table holding every key of [1, keyRangeSize] is saved to a snapshot file, and a
+ * fresh table is started from that file, without and with checksum verification. Reports the save time,
+ * the load time, the time of the first full scan after the load (which faults the file in), and, for
+ * comparison, the time to rebuild the table from the keys with a bulk load. The loaded table then takes
+ * keyRangeSize/10 more inserts (which copy the pages they write) and is validated again.
+ * (The file stays in the page cache, so this measures a warm restart.)
+ */
+template <class DataStructureType>
+void runRestartExperiment(int keyRangeSize, int tableSize, int totalThreads) {
+    int64_t expectedSum;
+    auto keys = shuffledKeyRange<DataStructureType>(keyRangeSize, expectedSum);
+    string path = "/tmp/benchmark_snapshot_" + to_string(getpid()) + ".bin";
+    auto elapsedMillis = [](auto start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    auto ds = new DataStructureType(totalThreads, tableSize);
+    auto start = std::chrono::high_resolution_clock::now();
+    doBulkLoad(ds, totalThreads, keys.data(), keyRangeSize);
+    cout<<"rebuild ms (bulk load)  : "<<elapsedMillis(start)<<endl;
+    start = std::chrono::high_resolution_clock::now();
+    if (!doSaveSnapshot(ds, path.c_str())) {
+        cout<<"ERROR: could not save a snapshot to "<<path<<" (only D and D64 support snapshot files)"<<endl;
+        exit(-1);
+    }
+    cout<<"save ms                 : "<<elapsedMillis(start)<<endl;
+    delete ds;
+
+    for (int verify = 0; verify < 2; verify++) {
+        ds = new DataStructureType(totalThreads, tableSize);
+        start = std::chrono::high_resolution_clock::now();
+        if (!doLoadSnapshot(ds, path.c_str(), verify)) {
+            cout<<"ERROR: could not load the snapshot from "<<path<<endl;
+            exit(-1);
+        }
+        cout<<(verify ? "load ms (checksummed)   : " : "load ms                 : ")<<elapsedMillis(start)<<endl;
+        start = std::chrono::high_resolution_clock::now();
+        auto dsSumOfKeys = ds->getSumOfKeys();
+        cout<<"first scan ms           : "<<elapsedMillis(start)<<endl;
+        validateSum(dsSumOfKeys, expectedSum);
+
+        int64_t moreSum = 0;
+        for (int k = keyRangeSize + 1; k <= keyRangeSize + keyRangeSize / 10; k++) moreSum += toTableKey(ds, k);
+        runOnAllThreads(totalThreads, [&](int tid) {
+            for (int k = keyRangeSize + 1 + tid; k <= keyRangeSize + keyRangeSize / 10; k += totalThreads) {
+                doInsert(ds, tid, toTableKey(ds, k), 0);
+            }
+        });
+        ds->printDebuggingDetails();
+        validateSum(ds->getSumOfKeys(), expectedSum + moreSum);
+        cout<<endl;
+        delete ds;
+    }
+    unlink(path.c_str());
+}
+
+// runs the experiment selected by mode ("mix", "shrink", "probe", "build" or "restart")
+template <class DataStructureType>
+void runMode(const char * mode, int keyRangeSize, int tableSize, int millisToRun, int totalThreads, const workload_t & w, bool measureLatency) {
+    if (!strcmp(mode, "shrink")) {
+        runShrinkExperiment<DataStructureType>(keyRangeSize, tableSize, totalThreads);
+    } else if (!strcmp(mode, "probe")) {
+        runProbeExperiment<DataStructureType>(keyRangeSize, tableSize, totalThreads, w.batchSize);
+    } else if (!strcmp(mode, "build")) {
+        runBuildExperiment<DataStructureType>(keyRangeSize, tableSize, totalThreads);
+    } else if (!strcmp(mode, "restart")) {
+        runRestartExperiment<DataStructureType>(keyRangeSize, tableSize, totalThreads);
+    } else {
+        runExperiment<DataStructureType>(keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+}
+
+// sets index to the position of arg in names (for the flags that pick one of a few named options)
+bool parseChoice(const char * arg, std::initializer_list<const char *> names, int & index) {
+    int i = 0;
+    for (auto name : names) {
+        if (!strcmp(arg, name)) {
+            index = i;
+            return true;
+        }
+        i++;
+    }
+    return false;
+}
+
 int main(int argc, char** argv) {
     if (argc == 1) {
         cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
         cout<<"Options:"<<endl;
-        cout<<"    -a  [string]   [a]lgorithm name in { A, B, C, D }"<<endl;
+        cout<<"    -a  [string]   [a]lgorithm name in { A, ARW, AMCS, ASEQ, B, C, D, D64, DM, E, F } (ARW/AMCS/ASEQ = A with striped reader-writer/MCS/seq locks, D64 = D with 64-bit keys, DM = key-value variant of D, runs a get/put workload, E = Robin Hood, F = cuckoo)"<<endl;
         cout<<"    -sT [int]      size of initial hash [T]able"<<endl;
         cout<<"    -m  [int]      [m]illiseconds to run"<<endl;
         cout<<"    -sR [int]      size of the key [R]ange that random keys will be drawn from (i.e., range [1, s])"<<endl;
         cout<<"    -t  [int]      number of [t]hreads that will perform inserts and deletes"<<endl;
+        cout<<"    -pL [num]      [p]ercentage of operations that are [L]ookups (contains) (default 0)"<<endl;
+        cout<<"    -pI [num]      [p]ercentage of operations that are [I]nserts (default: half of what -pL and -pE leave)"<<endl;
+        cout<<"    -pE [num]      [p]ercentage of operations that are [E]rases (default: whatever the other two leave)"<<endl;
+        cout<<"    -dist [string] key distribution in { uniform, zipf, hotspot, seq } (default uniform)"<<endl;
+        cout<<"    -zipf [num]    skew theta of the zipf distribution, in (0, 1) (default 0.99)"<<endl;
+        cout<<"    -hotOps [num]  hotspot: percentage of operations that go to the hot keys (default 80)"<<endl;
+        cout<<"    -hotKeys [num] hotspot: percentage of the key range that is hot (default 20)"<<endl;
+        cout<<"    -batch [int]   issue operations in batches of this many keys (insertBatch, eraseBatch, containsBatch), at most "<<MAX_BATCH_SIZE<<" (default 1: single operations)"<<endl;
+        cout<<"    -lat           measure the latency of every operation and print p50/p90/p99/p99.9/max per operation type, split by whether the operation overlapped a resize"<<endl;
+        cout<<"    -pages [string] memory for D's table arrays in { small, thp, hugetlb } (default small: calloc, mmap from "<<(TABLE_MMAP_MIN_BYTES >> 20)<<"MB up; thp: mmap + MADV_HUGEPAGE; hugetlb: explicit 2MB pages, THP if the pool is short; thp and hugetlb only for arrays of at least "<<(TABLE_HUGE_PAGE_MIN_BYTES >> 20)<<"MB)"<<endl;
+        cout<<"    -numa [string] placement of D's table arrays in { local, interleave, spread } (default local: first touch; interleave: round-robin over the NUMA nodes; spread: zeroed by all OpenMP threads)"<<endl;
+        cout<<"    -mode [string] experiment in { mix, shrink, probe, build, restart } (default mix; shrink inserts all of [1, sR], erases 90%, and reports memory and scan time after each phase; probe fills half of [1, sR] and reports ns per lookup; build times filling a fresh table with all of [1, sR] by inserts and by bulk load; restart (D, D64) saves a table holding [1, sR] to a snapshot file and times starting a fresh table from it; all of them ignore -m)"<<endl;
         cout<<endl;
         cout<<"Example: "<<argv[0]<<" -a D -m 10000 -sT 1000 -sR 1000000 -t 16"<<endl;
         return 1;
@@ -219,7 +737,21 @@ int main(int argc, char** argv) {
     int tableSize = 0;
     int keyRangeSize = 0;
     int totalThreads = 0;
+    workload_t w;
+    w.lookupPercent = 0;
+    w.insertPercent = -1;
+    w.erasePercent = -1;
+    w.dist = DIST_UNIFORM;
+    w.zipfTheta = 0.99;
+    w.hotOpPercent = 80;
+    w.hotKeyPercent = 20;
+    w.batchSize = 1;
+    const char * dist = "uniform";
     char * alg = NULL;
+    const char * mode = "mix";
+    const char * pages = "small";
+    const char * numa = "local";
+    bool measureLatency = false;
     
     // read command line args
     for (int i=1;i<argc;++i) {
@@ -231,14 +763,61 @@ int main(int argc, char** argv) {
             totalThreads = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-m") == 0) {
             millisToRun = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-pL") == 0) {
+            w.lookupPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-pI") == 0) {
+            w.insertPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-pE") == 0) {
+            w.erasePercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-dist") == 0) {
+            dist = argv[++i];
+        } else if (strcmp(argv[i], "-zipf") == 0) {
+            w.zipfTheta = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-hotOps") == 0) {
+            w.hotOpPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-hotKeys") == 0) {
+            w.hotKeyPercent = atof(argv[++i]);
         } else if (strcmp(argv[i], "-a") == 0) {
             alg = argv[++i];
+        } else if (strcmp(argv[i], "-batch") == 0) {
+            w.batchSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-lat") == 0) {
+            measureLatency = true;
+        } else if (strcmp(argv[i], "-mode") == 0) {
+            mode = argv[++i];
+        } else if (strcmp(argv[i], "-pages") == 0) {
+            pages = argv[++i];
+        } else if (strcmp(argv[i], "-numa") == 0) {
+            numa = argv[++i];
         } else {
             cout<<"bad arguments"<<endl;
             exit(1);
         }
     }
     
+    // unspecified operation percentages share what is left
+    if (w.insertPercent < 0 && w.erasePercent < 0) {
+        w.insertPercent = (100 - w.lookupPercent) / 2;
+        w.erasePercent = 100 - w.lookupPercent - w.insertPercent;
+    } else if (w.insertPercent < 0) {
+        w.insertPercent = 100 - w.lookupPercent - w.erasePercent;
+    } else if (w.erasePercent < 0) {
+        w.erasePercent = 100 - w.lookupPercent - w.insertPercent;
+    }
+    
+    if (!keyDistribution::parse(dist, w.dist)) {
+        cout<<"Bad key distribution: "<<dist<<endl;
+        return 1;
+    }
+    if (!parseChoice(pages, { "small", "thp", "hugetlb" }, tableMemory.pages)) {
+        cout<<"Bad page kind: "<<pages<<endl;
+        return 1;
+    }
+    if (!parseChoice(numa, { "local", "interleave", "spread" }, tableMemory.placement)) {
+        cout<<"Bad placement: "<<numa<<endl;
+        return 1;
+    }
+    
     // print command and args for debugging
     std::cout<<"Cmd:";
     for (int i=0;i<argc;++i) {
@@ -252,7 +831,18 @@ int main(int argc, char** argv) {
     PRINT(keyRangeSize);
     PRINT(tableSize);
     PRINT(totalThreads);
+    PRINT(w.lookupPercent);
+    PRINT(w.insertPercent);
+    PRINT(w.erasePercent);
+    PRINT(dist);
+    if (w.dist == DIST_ZIPF) PRINT(w.zipfTheta);
+    if (w.dist == DIST_HOTSPOT) { PRINT(w.hotOpPercent); PRINT(w.hotKeyPercent); }
     PRINT(alg);
+    PRINT(mode);
+    PRINT(pages);
+    PRINT(numa);
+    PRINT(w.batchSize);
+    PRINT(measureLatency);
     cout<<endl;
     
     // check for too large thread count
@@ -261,6 +851,35 @@ int main(int argc, char** argv) {
         return 1;
     }
     
+    if (w.lookupPercent < 0 || w.insertPercent < 0 || w.erasePercent < 0
+            || fabs(w.lookupPercent + w.insertPercent + w.erasePercent - 100) > 1e-9) {
+        cout<<"ERROR: operation percentages lookup="<<w.lookupPercent<<" insert="<<w.insertPercent<<" erase="<<w.erasePercent<<" must be non-negative and add up to 100"<<endl;
+        return 1;
+    }
+    
+    if (w.dist == DIST_ZIPF && !(w.zipfTheta > 0 && w.zipfTheta < 1)) {
+        cout<<"ERROR: zipf theta="<<w.zipfTheta<<" must be in (0, 1)"<<endl;
+        return 1;
+    }
+    if (w.dist == DIST_HOTSPOT && (w.hotOpPercent < 0 || w.hotOpPercent > 100 || w.hotKeyPercent <= 0 || w.hotKeyPercent > 100)) {
+        cout<<"ERROR: hotOps="<<w.hotOpPercent<<" must be in [0, 100] and hotKeys="<<w.hotKeyPercent<<" in (0, 100]"<<endl;
+        return 1;
+    }
+    
+    if (w.batchSize < 1 || w.batchSize > MAX_BATCH_SIZE) {
+        cout<<"ERROR: batch size="<<w.batchSize<<" must be in [1, "<<MAX_BATCH_SIZE<<"]"<<endl;
+        return 1;
+    }
+    if (w.batchSize > 1 && measureLatency) {
+        cout<<"ERROR: -lat times single operations, so it cannot be combined with -batch"<<endl;
+        return 1;
+    }
+    
+    if (strcmp(mode, "mix") && strcmp(mode, "shrink") && strcmp(mode, "probe") && strcmp(mode, "build") && strcmp(mode, "restart")) {
+        cout<<"Bad mode: "<<mode<<endl;
+        return 1;
+    }
+    
     // check for missing alg name
     if (alg == NULL) {
         cout<<"Must specify algorithm name"<<endl;
@@ -269,16 +888,37 @@ int main(int argc, char** argv) {
     
     // run experiment for the selected algorithm
     if (!strcmp(alg, "A")) {
-        runExperiment<AlgorithmA>(keyRangeSize, tableSize, millisToRun, totalThreads);
+        runMode<AlgorithmA>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+	else if (!strcmp(alg, "ARW")) {
+         runMode<AlgorithmAStriped<rwStripeLock>>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+	else if (!strcmp(alg, "AMCS")) {
+         runMode<AlgorithmAStriped<mcsStripeLock>>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+	else if (!strcmp(alg, "ASEQ")) {
+         runMode<AlgorithmAStriped<seqStripeLock>>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
     }
 	else if (!strcmp(alg, "B")) {
-         runExperiment<AlgorithmB>(keyRangeSize, tableSize, millisToRun, totalThreads);
+         runMode<AlgorithmB>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
     }
 	else if (!strcmp(alg, "C")) {
-         runExperiment<AlgorithmC>(keyRangeSize, tableSize, millisToRun, totalThreads);
+         runMode<AlgorithmC>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+	else if (!strcmp(alg, "E")) {
+         runMode<AlgorithmE>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+	else if (!strcmp(alg, "F")) {
+         runMode<AlgorithmF>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
     }
 	else if (!strcmp(alg, "D")) {
-         runExperiment<AlgorithmD>(keyRangeSize, tableSize, millisToRun, totalThreads);
+         runMode<AlgorithmD<>>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+	else if (!strcmp(alg, "D64")) {
+         runMode<AlgorithmD<int64_t>>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
+    }
+	else if (!strcmp(alg, "DM")) {
+         runMode<AlgorithmDMap>(mode, keyRangeSize, tableSize, millisToRun, totalThreads, w, measureLatency);
     }
  	else {
         cout<<"Bad algorithm name: "<<alg<<endl;
@@ -0,0 +1,135 @@
+#pragma once
+#include "util.h"
+#include <atomic>
+#include <vector>
+#include <utility>
+using namespace std;
+
+/**
+ * Epoch-based memory reclamation (EBR), keyed by the same tid that every
+ * hash table operation already receives.
+ *
+ * A thread brackets each operation with startOp/endOp. While inside an
+ * operation it announces the global epoch it observed; between operations it
+ * announces QUIESCENT. An object retired in epoch e can be freed once the
+ * global epoch reaches e+2, since by then every thread that could still hold
+ * a reference to it has finished the operation in which it obtained it.
+ *
+ * startOp/endOp nest (the tables call themselves recursively), so only the
+ * outermost pair touches shared memory.
+ */
+template <class T>
+class EpochReclaimer {
+private:
+    static constexpr uint64_t QUIESCENT = ~(uint64_t) 0;
+    static constexpr int OPS_BETWEEN_RECLAIM_ATTEMPTS = 64;
+
+    struct alignas(PADDING_BYTES) ThreadState {
+        std::atomic<uint64_t> announced;
+        int depth;
+        int opsSinceReclaim;
+        std::vector<std::pair<uint64_t, T *>> limbo;   // (retire epoch, object)
+    };
+
+    char padding0[PADDING_BYTES];
+    std::atomic<uint64_t> epoch;
+    char padding1[PADDING_BYTES];
+    const int numThreads;
+    char padding2[PADDING_BYTES];
+    ThreadState threads[MAX_THREADS];
+
+    // advance the global epoch if every thread inside an operation has seen the current one
+    void tryAdvance() {
+        uint64_t e = epoch.load();
+        for (int i = 0; i < numThreads; i++) {
+            uint64_t a = threads[i].announced.load();
+            if (a != QUIESCENT && a != e)
+                return;
+        }
+        epoch.compare_exchange_strong(e, e + 1);
+    }
+
+    void freeSafe(const int tid) {
+        auto & limbo = threads[tid].limbo;
+        uint64_t e = epoch.load();
+        size_t kept = 0;
+        for (size_t i = 0; i < limbo.size(); i++) {
+            if (limbo[i].first + 2 <= e) {
+                delete limbo[i].second;
+            } else {
+                limbo[kept++] = limbo[i];
+            }
+        }
+        limbo.resize(kept);
+    }
+
+    void reclaim(const int tid) {
+        tryAdvance();
+        freeSafe(tid);
+    }
+
+public:
+    EpochReclaimer(const int _numThreads) : epoch(0), numThreads(_numThreads) {
+        for (int i = 0; i < MAX_THREADS; i++) {
+            threads[i].announced.store(QUIESCENT, std::memory_order_relaxed);
+            threads[i].depth = 0;
+            threads[i].opsSinceReclaim = 0;
+        }
+    }
+
+    // only called once no thread is using the data structure any more
+    ~EpochReclaimer() {
+        for (int i = 0; i < MAX_THREADS; i++) {
+            for (auto & item : threads[i].limbo) delete item.second;
+        }
+    }
+
+    void startOp(const int tid) {
+        if (threads[tid].depth++ == 0) {
+            // seq_cst store: the announcement must be visible before we read any shared pointer
+            threads[tid].announced.store(epoch.load(std::memory_order_relaxed));
+        }
+    }
+
+    void endOp(const int tid) {
+        ThreadState & s = threads[tid];
+        if (--s.depth == 0) {
+            s.announced.store(QUIESCENT, std::memory_order_release);
+            // only threads holding garbage ever pay for reclamation
+            if (!s.limbo.empty() && ++s.opsSinceReclaim >= OPS_BETWEEN_RECLAIM_ATTEMPTS) {
+                s.opsSinceReclaim = 0;
+                reclaim(tid);
+            }
+        }
+    }
+
+    // obj must already be unreachable for any operation that starts from now on
+    void retire(const int tid, T * obj) {
+        threads[tid].limbo.push_back({epoch.load(), obj});
+    }
+
+    // number of retired objects that have not been freed yet (for debugging)
+    int64_t getPendingCount() {
+        int64_t ret = 0;
+        for (int i = 0; i < MAX_THREADS; i++) ret += threads[i].limbo.size();
+        return ret;
+    }
+};
+
+/**
+ * RAII helper around startOp/endOp, so early returns cannot leave a thread
+ * announced forever (which would stall reclamation for everyone).
+ */
+template <class T>
+class EpochGuard {
+private:
+    EpochReclaimer<T> & reclaimer;
+    const int tid;
+public:
+    EpochGuard(EpochReclaimer<T> & _reclaimer, const int _tid) : reclaimer(_reclaimer), tid(_tid) {
+        reclaimer.startOp(tid);
+    }
+    ~EpochGuard() {
+        reclaimer.endOp(tid);
+    }
+};
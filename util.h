@@ -5,6 +5,17 @@
 #include <atomic>
 #include <sstream>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 using namespace std;
 
 #ifndef MAX_THREADS
@@ -43,6 +54,15 @@ struct PaddedInt64 {
     char padding[PADDING_BYTES - sizeof(v)];
 };
 
+/**
+ * Approximate shared counter: every thread adds into its own padded subcounter and moves the total into
+ * globalCounter once its magnitude reaches the flush threshold, so get() is off by less than errorBound().
+ *
+ * The threshold adapts: the owner calls setHeadroom with how far the count may still move before it has
+ * to act on it, and the threshold becomes a power of two of about headroom / (2 * numThreads), between 1 and
+ * MAX_FLUSH_THRESHOLD. Far from the trigger, threads rarely touch the shared line; close to it, get() is
+ * nearly exact. Only the first numThreads subcounters are used, so tid must be below numThreads.
+ */
 class counter {
 private:
     char padding0[64];
@@ -52,35 +72,57 @@ private:
     char padding1[64];
     const int numThreads;
     char padding2[64];
+    atomic<int64_t> flushThreshold;
+    atomic<int64_t> peakThreshold;      // largest threshold since construction: a thread idle since then may still hold that much
+    char padding3[64];
+
 public:
-    counter(int _numThreads) : numThreads(_numThreads), globalCounter(0) {
-        for (int i=0;i<MAX_THREADS;++i) subcounters[i].v = 0;
-    }
-    int64_t inc(int tid) {
-        auto val = ++subcounters[tid].v;
-        // if (val >= max(100, 30*numThreads)) {
-        if (val >= 100) {               // Better to be dynamic!
-            // printf("Reached\n");
+    static constexpr int64_t MAX_FLUSH_THRESHOLD = 128;
+
+    counter(int _numThreads, int64_t headroom = INT64_MAX)
+    : globalCounter(0), numThreads(_numThreads), flushThreshold(1), peakThreshold(1) {
+        for (int i=0;i<numThreads;++i) subcounters[i].v = 0;
+        setHeadroom(headroom);
+    }
+    void add(int tid, int64_t delta) {
+        auto val = subcounters[tid].v + delta;
+        subcounters[tid].v = val;
+        auto threshold = flushThreshold.load(std::memory_order_relaxed);
+        if (val >= threshold || val <= -threshold) {
             globalCounter.fetch_add(val);
-            // printf("global counter val: %ld\n", globalCounter.load());
             subcounters[tid].v = 0;
         }
-        return -1; // dummy return value
-    }
-    // int64_t dec(int tid) {
-    //     auto val = --subcounters[tid].v;
-    //     if (val <= -max(1000, 30 * numThreads)) {
-    //         globalCounter.fetch_add(val);
-    //         subcounters[tid].v = 0;
-    //     }
-    //     return -1; // dummy return value
-    // }
+    }
+    void inc(int tid) {
+        add(tid, 1);
+    }
+    void dec(int tid) {
+        add(tid, -1);
+    }
+    // the caller acts once the count has moved by about headroom; get() should stay well within that
+    void setHeadroom(int64_t headroom) {
+        // fast path (every operation of the owner calls this): the threshold already fits headroom
+        int64_t current = flushThreshold.load(std::memory_order_relaxed);
+        int64_t perThread = 2 * numThreads * current;
+        if ((current == 1 || headroom >= perThread) && (current == MAX_FLUSH_THRESHOLD || headroom < 2 * perThread))
+            return;
+        int64_t target = std::max<int64_t>(1, std::min<int64_t>(MAX_FLUSH_THRESHOLD, headroom / (2 * numThreads)));
+        int64_t threshold = 1;
+        while (threshold * 2 <= target) threshold *= 2;
+        flushThreshold.store(threshold, std::memory_order_relaxed);
+        int64_t peak = peakThreshold.load(std::memory_order_relaxed);
+        while (peak < threshold && !peakThreshold.compare_exchange_weak(peak, threshold)) {}
+    }
+    // |getAccurate() - get()| <= errorBound(), as long as no thread is in the middle of an update
+    int64_t errorBound() {
+        return numThreads * (peakThreshold.load(std::memory_order_relaxed) - 1);
+    }
     int64_t get() {
         return globalCounter;
     }
     int64_t getAccurate() {
         int64_t ret = 0;
-        for (int i=0;i<MAX_THREADS;++i) {
+        for (int i=0;i<numThreads;++i) {
             ret += subcounters[i].v;
         }
         ret += globalCounter;
@@ -169,6 +211,451 @@ public:
     }
 } __attribute__((aligned(PADDING_BYTES)));
 
+/**
+ * Per-thread log-linear latency histogram (HDR style). Values below SUB_BUCKETS get a bucket each;
+ * above that, every power of two is split into SUB_BUCKETS buckets, so a reported percentile is
+ * within about 1/SUB_BUCKETS of the real value. Threads only write their own row.
+ */
+class latencyHistogram {
+private:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    struct alignas(PADDING_BYTES) row {
+        uint64_t counts[NUM_BUCKETS];
+        uint64_t max;
+    };
+    row * rows;
+    const int numThreads;
+
+    static int bucketOf(uint64_t v) {
+        if (v < SUB_BUCKETS) return (int) v;
+        int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + (int) ((v >> shift) & (SUB_BUCKETS - 1));
+    }
+    // largest value that falls into bucket b
+    static uint64_t bucketHigh(int b) {
+        if (b < SUB_BUCKETS) return b;
+        int shift = b / SUB_BUCKETS - 1;
+        return ((uint64_t) (SUB_BUCKETS + b % SUB_BUCKETS + 1) << shift) - 1;
+    }
+public:
+    latencyHistogram(int _numThreads) : numThreads(_numThreads) {
+        rows = new row[numThreads];
+        for (int i=0;i<numThreads;++i) {
+            memset(rows[i].counts, 0, sizeof(rows[i].counts));
+            rows[i].max = 0;
+        }
+    }
+    ~latencyHistogram() {
+        delete[] rows;
+    }
+    void record(const int tid, uint64_t value) {
+        rows[tid].counts[bucketOf(value)]++;
+        if (value > rows[tid].max) rows[tid].max = value;
+    }
+    uint64_t getCount() {
+        uint64_t ret = 0;
+        for (int i=0;i<numThreads;++i)
+            for (int b=0;b<NUM_BUCKETS;++b) ret += rows[i].counts[b];
+        return ret;
+    }
+    uint64_t getMax() {
+        uint64_t ret = 0;
+        for (int i=0;i<numThreads;++i) ret = std::max(ret, rows[i].max);
+        return ret;
+    }
+    // smallest recorded value v such that a fraction p of all values is <= v (up to bucket precision)
+    uint64_t getPercentile(double p) {
+        uint64_t total = getCount();
+        if (total == 0) return 0;
+        uint64_t target = (uint64_t) ceil(p * total);
+        if (target == 0) target = 1;
+        uint64_t seen = 0;
+        for (int b=0;b<NUM_BUCKETS;++b) {
+            for (int i=0;i<numThreads;++i) seen += rows[i].counts[b];
+            if (seen >= target) return std::min(bucketHigh(b), getMax());
+        }
+        return getMax();
+    }
+};
+
+/**
+ * reads a "Vm*:" line (in kB) from /proc/self/status and returns it in bytes, or -1 if unavailable.
+ * VmRSS is the current resident set size, VmHWM is its peak ("high water mark").
+ */
+int64_t readProcStatusBytes(const char * field) {
+    FILE * f = fopen("/proc/self/status", "r");
+    if (f == NULL) return -1;
+    char line[256];
+    int64_t ret = -1;
+    size_t len = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, field, len) == 0 && line[len] == ':') {
+            ret = atoll(line + len + 1) * 1024;
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+/**
+ * How a probe turns (hash, probe offset) into a slot index. Every table goes through probeIndex.
+ *   PROBE_MODULO:    (h + i) % capacity, for any capacity (default)
+ *   PROBE_MASK:      capacities are rounded up to a power of two, so (h + i) & (capacity - 1) replaces the division
+ *   PROBE_FASTRANGE: any capacity; the home slot is (h * capacity) >> 32 (multiply-shift range reduction)
+ *                    and probing wraps around with a compare instead of a division
+ */
+#define PROBE_MODULO 0
+#define PROBE_MASK 1
+#define PROBE_FASTRANGE 2
+#ifndef PROBE_INDEXING
+#define PROBE_INDEXING PROBE_MODULO
+#endif
+
+// capacity that a table asked for capacity actually gets
+inline int roundCapacity(int capacity) {
+    if (PROBE_INDEXING != PROBE_MASK) return capacity;
+    int ret = 1;
+    while (ret < capacity && ret < (1 << 30)) ret <<= 1;
+    return ret;
+}
+
+// slot probed at offset i (0 <= i < capacity) for hash h
+inline int probeIndex(uint32_t h, int i, int capacity) {
+    if (PROBE_INDEXING == PROBE_MASK) {
+        return (h + i) & (capacity - 1);
+    } else if (PROBE_INDEXING == PROBE_FASTRANGE) {
+        int index = (int) (((uint64_t) h * (uint32_t) capacity) >> 32) + i;
+        return index < capacity ? index : index - capacity;
+    }
+    return (h + i) % capacity;
+}
+
+// number of probe offsets i, i+1, ... (at most capacity - i) that land on consecutive slots index, index+1, ...
+// (index = probeIndex(h, i, capacity)); lets a probe look at a whole run of slots at once
+inline int probeRunLength(uint32_t h, int i, int index, int capacity) {
+    int run = std::min(capacity - i, capacity - index);
+    if (PROBE_INDEXING == PROBE_MODULO) {
+        uint64_t untilWrap = (1ULL << 32) - (uint32_t) (h + i);   // h + i wraps around in 32 bits
+        if (untilWrap < (uint64_t) run) run = (int) untilWrap;
+    }
+    return run;
+}
+
+/**
+ * Batched operations (insertBatch/eraseBatch/containsBatch of the tables): key j is resolved while
+ * the home slots of the next BATCH_PREFETCH_DISTANCE keys are being prefetched, so that many cache
+ * misses are in flight at once instead of one per operation.
+ *
+ * home(j) returns the address of key j's home slot, op(j) runs the operation on key j.
+ * (The prefetch is issued here rather than in home: GCC treats a function whose only effect is a
+ * prefetch as const, and drops calls to it whose result is unused.)
+ * @return number of keys for which op returned true (results[j] holds each one)
+ */
+#define BATCH_PREFETCH_DISTANCE 16
+
+template <bool forWrite, typename Home, typename Op>
+inline int runBatch(int n, bool * results, Home home, Op op) {
+    for (int j = 0; j < n && j < BATCH_PREFETCH_DISTANCE; j++) {
+        __builtin_prefetch(home(j), forWrite);
+    }
+    int ret = 0;
+    for (int j = 0; j < n; j++) {
+        if (j + BATCH_PREFETCH_DISTANCE < n)
+            __builtin_prefetch(home(j + BATCH_PREFETCH_DISTANCE), forWrite);
+        results[j] = op(j);
+        ret += results[j];
+    }
+    return ret;
+}
+
+/**
+ * Full-table scans (getSumOfKeys, forEachKey of the tables): the slots are cut into SCAN_CHUNK_SLOTS-sized
+ * chunks that OpenMP threads share, so a scan of a big table uses every core instead of one.
+ *
+ * parallelSum returns the sum of chunk(begin, end) over all chunks of [0, n);
+ * parallelFor calls chunk(begin, end) on all of them (from several threads at once).
+ */
+#define SCAN_CHUNK_SLOTS (1 << 16)
+
+template <typename Chunk>
+inline int64_t parallelSum(int64_t n, Chunk chunk) {
+    int64_t numChunks = (n + SCAN_CHUNK_SLOTS - 1) / SCAN_CHUNK_SLOTS;
+    int64_t sum = 0;
+    #pragma omp parallel for schedule(dynamic) reduction(+:sum) if(numChunks > 1)
+    for (int64_t c = 0; c < numChunks; c++) {
+        sum += chunk(c * SCAN_CHUNK_SLOTS, std::min(n, (c + 1) * SCAN_CHUNK_SLOTS));
+    }
+    return sum;
+}
+
+template <typename Chunk>
+inline void parallelFor(int64_t n, Chunk chunk) {
+    int64_t numChunks = (n + SCAN_CHUNK_SLOTS - 1) / SCAN_CHUNK_SLOTS;
+    #pragma omp parallel for schedule(dynamic) if(numChunks > 1)
+    for (int64_t c = 0; c < numChunks; c++) {
+        chunk(c * SCAN_CHUNK_SLOTS, std::min(n, (c + 1) * SCAN_CHUNK_SLOTS));
+    }
+}
+
+/**
+ * Sum of the keys in slots[begin, end), skipping the two sentinels. ignoreBits are cleared from every slot
+ * before it is compared and added (AlgorithmD's migration mark). Works on a table of std::atomic<int>
+ * (or a struct holding one) through a plain int pointer: the scan only needs each slot read once.
+ * On CPUs with AVX2 this compares 8 slots per instruction and adds them without branches.
+ */
+inline int64_t sumLiveKeysScalar(const int * slots, int64_t begin, int64_t end, int empty, int tombstone, int ignoreBits) {
+    int64_t sum = 0;
+    for (int64_t i = begin; i < end; i++) {
+        int key = slots[i] & ~ignoreBits;
+        sum += (key != empty && key != tombstone) ? key : 0;
+    }
+    return sum;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+inline int64_t sumLiveKeysAVX2(const int * slots, int64_t begin, int64_t end, int empty, int tombstone, int ignoreBits) {
+    const __m256i emptyV = _mm256_set1_epi32(empty);
+    const __m256i tombstoneV = _mm256_set1_epi32(tombstone);
+    const __m256i keepV = _mm256_set1_epi32(~ignoreBits);
+    __m256i acc = _mm256_setzero_si256();          // 4 x int64
+    int64_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (slots + i)), keepV);
+        __m256i sentinel = _mm256_or_si256(_mm256_cmpeq_epi32(v, emptyV), _mm256_cmpeq_epi32(v, tombstoneV));
+        v = _mm256_andnot_si256(sentinel, v);
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumLiveKeysScalar(slots, i, end, empty, tombstone, ignoreBits);
+}
+#endif
+
+inline int64_t sumLiveKeys(const int * slots, int64_t begin, int64_t end, int empty, int tombstone, int ignoreBits = 0) {
+#if defined(__x86_64__)
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (hasAVX2)
+        return sumLiveKeysAVX2(slots, begin, end, empty, tombstone, ignoreBits);
+#endif
+    return sumLiveKeysScalar(slots, begin, end, empty, tombstone, ignoreBits);
+}
+
+// 64-bit keys: the same filter, left to the compiler's vectorizer
+inline int64_t sumLiveKeys(const int64_t * slots, int64_t begin, int64_t end, int64_t empty, int64_t tombstone, int64_t ignoreBits = 0) {
+    int64_t sum = 0;
+    for (int64_t i = begin; i < end; i++) {
+        int64_t key = slots[i] & ~ignoreBits;
+        sum += (key != empty && key != tombstone) ? key : 0;
+    }
+    return sum;
+}
+
+// L2 cache size of this machine (1MB if the C library cannot tell)
+inline int64_t l2CacheBytes() {
+    static const int64_t bytes = []() {
+        long ret = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        ret = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        return ret > 0 ? (int64_t) ret : (int64_t) (1 << 20);
+    }();
+    return bytes;
+}
+
+/**
+ * Size of a migration chunk, in old-table slots of slotBytes bytes. A chunk's old slots fill at most a quarter
+ * of L2 (the rest is left for the new-table lines its keys go to), and a table is cut into at least
+ * MIGRATION_CHUNKS_PER_THREAD chunks per thread, so that small tables still spread over all the helpers and
+ * stealing has something to balance; but a chunk is never below MIN_MIGRATION_CHUNK_SLOTS.
+ */
+#define MIGRATION_CHUNKS_PER_THREAD 8
+#define MIN_MIGRATION_CHUNK_SLOTS 256
+inline int migrationChunkSlots(int oldCapacity, int numThreads, int slotBytes) {
+    int64_t cacheSlots = std::max<int64_t>(MIN_MIGRATION_CHUNK_SLOTS, l2CacheBytes() / 4 / slotBytes);
+    int64_t spreadSlots = ((int64_t) oldCapacity + (int64_t) numThreads * MIGRATION_CHUNKS_PER_THREAD - 1) / ((int64_t) numThreads * MIGRATION_CHUNKS_PER_THREAD);
+    return (int) std::min(cacheSlots, std::max<int64_t>(MIN_MIGRATION_CHUNK_SLOTS, spreadSlots));
+}
+
+/**
+ * Hands out chunks 0..numChunks-1 of a migration to the threads that help with it. Chunks are split into one
+ * contiguous range per thread, each with its own cursor (on its own cache line): a thread claims from its own
+ * range first, without contention, and then steals from the others, starting with the next thread's, so no
+ * chunk is left behind by a thread that stopped helping.
+ * claim returns -1 once every chunk has been handed out.
+ */
+class chunkClaimer {
+private:
+    struct alignas(PADDING_BYTES) range {
+        std::atomic<int> next;
+        int end;
+    };
+    range * ranges;
+    int numRanges;
+    alignas(PADDING_BYTES) std::atomic<bool> drained;           // every range is empty (spares the scan)
+    char padding[PADDING_BYTES - sizeof(std::atomic<bool>)];
+public:
+    chunkClaimer(int numChunks, int numThreads) : ranges(new range[numThreads]), numRanges(numThreads), drained(false) {
+        for (int r = 0; r < numRanges; r++) {
+            ranges[r].next.store((int) ((int64_t) numChunks * r / numRanges), std::memory_order_relaxed);
+            ranges[r].end = (int) ((int64_t) numChunks * (r + 1) / numRanges);
+        }
+    }
+    ~chunkClaimer() {
+        delete[] ranges;
+    }
+    int claim(const int tid) {
+        if (drained.load(std::memory_order_relaxed))
+            return -1;
+        for (int k = 0; k < numRanges; k++) {
+            range & r = ranges[(tid + k) % numRanges];
+            if (r.next.load(std::memory_order_relaxed) >= r.end)
+                continue;
+            int chunk = r.next.fetch_add(1);
+            if (chunk < r.end)
+                return chunk;
+        }
+        drained.store(true, std::memory_order_relaxed);
+        return -1;
+    }
+};
+
+/**
+ * Memory for big table arrays (AlgorithmD's slots and tags). The policy is global, set once before any
+ * table is created (the benchmark's -pages and -numa flags):
+ *
+ *   pages:     TABLE_PAGES_SMALL    4KB pages (default): calloc, or, from TABLE_MMAP_MIN_BYTES up, anonymous mmap
+ *              TABLE_PAGES_THP      anonymous mmap + MADV_HUGEPAGE: transparent 2MB pages where the kernel has them
+ *              TABLE_PAGES_HUGETLB  mmap with MAP_HUGETLB (explicit 2MB pages from the hugetlbfs pool; falls back
+ *                                   to TABLE_PAGES_THP when the pool is short, see hugetlbFallbacks)
+ *   placement: TABLE_PLACE_LOCAL      pages land on the node of the thread that first touches them (default)
+ *              TABLE_PLACE_INTERLEAVE pages are spread round-robin over the allowed NUMA nodes (mbind)
+ *              TABLE_PLACE_SPREAD     the array is zeroed by all OpenMP threads, so first touch spreads it
+ *                                     over the nodes they run on
+ *
+ * allocTableArray returns zeroed memory (the tables' EMPTY is 0) without writing it: mmapped pages are zeroed
+ * by the kernel when they are first touched, so a new table costs the thread that allocates it a system call,
+ * and each page is zeroed by whichever migrating thread first writes a key into it. (Only TABLE_PLACE_SPREAD
+ * writes the array up front, to choose who touches it first.) Arrays below TABLE_MMAP_MIN_BYTES come from
+ * calloc. The pages policy only applies from TABLE_HUGE_PAGE_MIN_BYTES up: smaller arrays (a small table, its
+ * tags, a migration's per-slot flags) get 4KB pages, since each would be rounded up to a whole huge page.
+ * Every array starts with a small header recording how it was allocated, so freeTableArray needs only the
+ * pointer.
+ */
+#define TABLE_PAGES_SMALL 0
+#define TABLE_PAGES_THP 1
+#define TABLE_PAGES_HUGETLB 2
+#define TABLE_PLACE_LOCAL 0
+#define TABLE_PLACE_INTERLEAVE 1
+#define TABLE_PLACE_SPREAD 2
+#define TABLE_ARRAY_HEADER_BYTES 64                            // keeps the array cache-line aligned
+#define HUGE_PAGE_BYTES (2 << 20)
+#define TABLE_MMAP_MIN_BYTES (1 << 20)
+#define TABLE_HUGE_PAGE_MIN_BYTES HUGE_PAGE_BYTES
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_F_MEMS_ALLOWED
+#define MPOL_F_MEMS_ALLOWED (1 << 2)
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << 26)
+#endif
+
+struct tableMemoryPolicy {
+    int pages = TABLE_PAGES_SMALL;
+    int placement = TABLE_PLACE_LOCAL;
+    std::atomic<int64_t> hugetlbFallbacks {0};                 // TABLE_PAGES_HUGETLB arrays that got THP instead
+    std::atomic<int64_t> interleaveFailures {0};               // arrays mbind refused to interleave
+};
+inline tableMemoryPolicy tableMemory;
+
+struct tableArrayHeader {
+    int64_t totalBytes;         // including this header
+    bool mapped;                // mmap (else calloc)
+};
+
+// zeroes [p, p + bytes) from all OpenMP threads, a huge page at a time
+inline void parallelZero(char * p, int64_t bytes) {
+    int64_t numChunks = (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES;
+    #pragma omp parallel for schedule(static) if(numChunks > 1)
+    for (int64_t c = 0; c < numChunks; c++) {
+        memset(p + c * HUGE_PAGE_BYTES, 0, std::min<int64_t>(HUGE_PAGE_BYTES, bytes - c * HUGE_PAGE_BYTES));
+    }
+}
+
+inline void * allocTableArray(int64_t bytes) {
+    int64_t totalBytes = bytes + TABLE_ARRAY_HEADER_BYTES;
+    const int pages = (totalBytes >= TABLE_HUGE_PAGE_MIN_BYTES) ? tableMemory.pages : TABLE_PAGES_SMALL;
+    const int placement = tableMemory.placement;
+    char * base;
+    // (not calloc for big arrays: glibc raises its mmap threshold after a big free, and then serves
+    // the next table from the heap, where calloc has to zero it on this thread)
+    bool mapped = (pages != TABLE_PAGES_SMALL || placement != TABLE_PLACE_LOCAL || totalBytes >= TABLE_MMAP_MIN_BYTES);
+    if (!mapped) {
+        base = (char *) calloc(1, totalBytes);
+        if (!base)
+            throw std::bad_alloc();
+    } else {
+        if (pages != TABLE_PAGES_SMALL)
+            totalBytes = (totalBytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+        void * p = MAP_FAILED;
+        if (pages == TABLE_PAGES_HUGETLB) {
+            p = mmap(nullptr, totalBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+            if (p == MAP_FAILED) tableMemory.hugetlbFallbacks++;
+        }
+        if (p == MAP_FAILED)
+            p = mmap(nullptr, totalBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        base = (char *) p;
+        if (pages == TABLE_PAGES_THP || pages == TABLE_PAGES_HUGETLB)
+            madvise(base, totalBytes, MADV_HUGEPAGE);           // (harmless on hugetlb pages)
+        if (placement == TABLE_PLACE_INTERLEAVE) {
+            // raw syscalls, so we do not need to link libnuma
+            unsigned long nodes[16] = {0};
+            if (syscall(SYS_get_mempolicy, nullptr, nodes, 64 * 16, nullptr, MPOL_F_MEMS_ALLOWED) != 0
+                    || syscall(SYS_mbind, base, totalBytes, MPOL_INTERLEAVE, nodes, 64 * 16, 0) != 0)
+                tableMemory.interleaveFailures++;
+        }
+        if (placement == TABLE_PLACE_SPREAD) parallelZero(base, totalBytes);
+    }
+    auto header = (tableArrayHeader *) base;
+    header->totalBytes = totalBytes;
+    header->mapped = mapped;
+    return base + TABLE_ARRAY_HEADER_BYTES;
+}
+
+inline void freeTableArray(void * array) {
+    if (!array) return;
+    char * base = (char *) array - TABLE_ARRAY_HEADER_BYTES;
+    auto header = (tableArrayHeader *) base;
+    if (header->mapped) munmap(base, header->totalBytes);
+    else free(base);
+}
+
+// (for printDebuggingDetails)
+inline const char * tableMemoryName() {
+    const char * pages[] = { "small pages", "transparent huge pages", "hugetlb pages" };
+    const char * placements[] = { "local", "interleaved", "spread" };
+    static char name[64];
+    snprintf(name, sizeof(name), "%s, %s", pages[tableMemory.pages], placements[tableMemory.placement]);
+    return name;
+}
+
+int64_t getResidentBytes() {
+    return readProcStatusBytes("VmRSS");
+}
+
+int64_t getPeakResidentBytes() {
+    return readProcStatusBytes("VmHWM");
+}
+
 uint32_t murmur3(uint32_t key) {
     constexpr uint32_t seed = 0x1a8b714c;
     constexpr uint32_t c1 = 0xCC9E2D51;
@@ -194,5 +681,20 @@ uint32_t murmur3(uint32_t key) {
     return h;
 }
 
+/**
+ * 64-bit counterpart of murmur3: the MurmurHash3 64-bit finalizer (fmix64) applied to key ^ seed.
+ */
+uint64_t murmur3_64(uint64_t key) {
+    constexpr uint64_t seed = 0x1a8b714c5e2d7f31ULL;
+
+    uint64_t h = key ^ seed;
+    h ^= (h>>33);
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= (h>>33);
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= (h>>33);
+    return h;
+}
+
 #endif /* UTIL_H */
 
@@ -0,0 +1,88 @@
+#pragma once
+#include "util.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+using namespace std;
+
+// Keys per thread that are generated before a trial starts; threads cycle through their stream.
+#define KEY_STREAM_LENGTH (1 << 20)
+
+enum KeyDistributionType { DIST_UNIFORM, DIST_ZIPF, DIST_HOTSPOT, DIST_SEQUENTIAL };
+
+/**
+ * Describes how the benchmark draws keys from [1, keyRangeSize]:
+ *
+ * uniform:    every key equally likely
+ * zipf:       key k has probability proportional to 1/k^theta (0 < theta < 1; k = 1 is the hottest)
+ * hotspot:    a fraction hotOpFraction of the draws hits the first hotKeyFraction of the range, the
+ *             rest hits the remaining keys (both uniformly)
+ * sequential: thread tid produces tid+1, tid+1+totalThreads, ... wrapping around at the end of the range
+ */
+class keyDistribution {
+private:
+    KeyDistributionType type;
+    int keyRangeSize;
+    double zipfTheta;
+    double hotOpFraction;
+    double hotKeyFraction;
+
+    // Zipf constants (Gray et al., "Quickly generating billion-record synthetic databases", SIGMOD '94)
+    double zetaN;
+    double zipfAlpha;
+    double zipfEta;
+
+    static double nextUnit(PaddedRandom & rng) {
+        return rng.nextNatural() / (double) numeric_limits<unsigned int>::max();
+    }
+
+    int nextZipf(PaddedRandom & rng) const {
+        double u = nextUnit(rng);
+        double uz = u * zetaN;
+        if (uz < 1) return 1;
+        if (uz < 1 + pow(0.5, zipfTheta)) return 2;
+        int k = 1 + (int) (keyRangeSize * pow(zipfEta * u - zipfEta + 1, zipfAlpha));
+        return min(k, keyRangeSize);
+    }
+
+    int nextHotspot(PaddedRandom & rng) const {
+        int hotKeys = max(1, (int) (keyRangeSize * hotKeyFraction));
+        if (hotKeys >= keyRangeSize || nextUnit(rng) < hotOpFraction)
+            return 1 + rng.nextNatural() % hotKeys;
+        return 1 + hotKeys + rng.nextNatural() % (keyRangeSize - hotKeys);
+    }
+
+public:
+    keyDistribution(KeyDistributionType _type, int _keyRangeSize, double _zipfTheta, double _hotOpFraction, double _hotKeyFraction)
+    : type(_type), keyRangeSize(_keyRangeSize), zipfTheta(_zipfTheta), hotOpFraction(_hotOpFraction), hotKeyFraction(_hotKeyFraction),
+      zetaN(0), zipfAlpha(0), zipfEta(0) {
+        if (type == DIST_ZIPF) {
+            double zeta2 = 1 + pow(0.5, zipfTheta);
+            for (int i = 1; i <= keyRangeSize; i++) zetaN += 1 / pow((double) i, zipfTheta);
+            zipfAlpha = 1 / (1 - zipfTheta);
+            zipfEta = (1 - pow(2. / keyRangeSize, 1 - zipfTheta)) / (1 - zeta2 / zetaN);
+        }
+    }
+
+    // returns false if name is not a distribution
+    static bool parse(const char * name, KeyDistributionType & result) {
+        if (!strcmp(name, "uniform")) result = DIST_UNIFORM;
+        else if (!strcmp(name, "zipf")) result = DIST_ZIPF;
+        else if (!strcmp(name, "hotspot")) result = DIST_HOTSPOT;
+        else if (!strcmp(name, "seq")) result = DIST_SEQUENTIAL;
+        else return false;
+        return true;
+    }
+
+    // fills keys[0..n) with the key stream of thread tid
+    void fillStream(const int tid, const int totalThreads, PaddedRandom & rng, int * keys, int n) const {
+        for (int i = 0; i < n; i++) {
+            switch (type) {
+                case DIST_UNIFORM:    keys[i] = 1 + rng.nextNatural() % keyRangeSize; break;
+                case DIST_ZIPF:       keys[i] = nextZipf(rng); break;
+                case DIST_HOTSPOT:    keys[i] = nextHotspot(rng); break;
+                case DIST_SEQUENTIAL: keys[i] = 1 + (int) ((tid + (int64_t) i * totalThreads) % keyRangeSize); break;
+            }
+        }
+    }
+};